@@ -0,0 +1,30 @@
+#ifndef HASH_FUNCTION_H
+#define HASH_FUNCTION_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define HASH_STRING_LANES 8
+
+uint64_t hashString(const char* data, size_t length);
+
+// djb2 of a string without its seed, which makes it linear: parts hashed
+// apart can be joined into the hash of their concatenation
+typedef struct HashStringPart
+{
+    uint64_t sum;
+    uint64_t power; // 33 to the power of the length
+} HashStringPart;
+
+HashStringPart hashStringPart(const char* data, size_t length);
+HashStringPart hashStringJoin(HashStringPart first, HashStringPart second);
+uint64_t hashStringFinish(HashStringPart part);
+
+// hashString of the key with every run of whitespace replaced by one space
+uint64_t hashStringTokens(const char* data, size_t length);
+
+// hashes HASH_STRING_LANES keys at once; the result is bit-identical to the
+// low 32 bits of hashString, which is all the table uses
+void hashString8(const char* const* keys, const size_t* lengths, uint32_t* hashes);
+
+#endif // HASH_FUNCTION_H
@@ -2,10 +2,10 @@
 #define HASH_TABLE_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <stdbool.h>
 
-#include "list.h"
-
 typedef enum HashTableOperationError
 {
     HASH_TABLE_SUCCESS               = 0,
@@ -18,27 +18,143 @@ typedef enum HashTableOperationError
 typedef struct HashTable HashTable;
 
 HashTable* hashTableCtor(void);
+HashTable* hashTableCtorWithHint(size_t expected_length);
+// every entry carries value_size bytes, zeroed when the key is inserted
+HashTable* hashTableCtorWithValues(size_t expected_length, size_t value_size);
 HashTableOperationError hashTableDtor(HashTable* table);
 
+HashTableOperationError hashTableReserve(HashTable* table, size_t length);
+
+// Cache mode: once inserting a new key would pass max_entries keys or
+// max_bytes of entries, values and key bytes (zero disables a limit), keys
+// are evicted by a CLOCK hand that halves the count of every key it passes
+// and takes the first one with a count of one. Counts so decay like a
+// frequency estimate. evict, if given, gets every evicted key to release it,
+// keys still deferred for readers keep the callback they were evicted under.
+typedef void (*HashTableEvict)(const char* key, size_t length, size_t count, void* argument);
+
+HashTableOperationError hashTableSetCacheLimit(HashTable* table, size_t max_entries,
+                                               size_t max_bytes, HashTableEvict evict,
+                                               void* argument);
+
+// Builds with HASH_TABLE_COMPACT_ENTRIES store keys as 32-bit offsets from this
+// base, so every key must lie within 4 GiB after it and be shorter than 64 KiB.
+// Must be set before the first insert, other builds ignore it.
+HashTableOperationError hashTableSetKeyBase(HashTable* table, const char* key_base);
+
+// Token mode: keys are word sequences and any run of whitespace inside a key
+// equals any other, so "of  the" and "of\nthe" are one key hashed by
+// hashStringTokens. Must be set before the first insert.
+HashTableOperationError hashTableSetTokenKeys(HashTable* table);
+bool hashTableHasTokenKeys(HashTable* table);
+
 size_t hashTableGet(HashTable* table, const char* key, size_t length);
 const char* hashTableSet(HashTable* table, const char* key, size_t length);
-HashTableOperationError hashTableDelete(HashTable* table, const char* key);
+// hash must be the one the table would compute for the key
+size_t hashTableGetWithHash(HashTable* table, const char* key, size_t length, uint64_t hash);
+const char* hashTableSetWithHash(HashTable* table, const char* key, size_t length, uint64_t hash);
+HashTableOperationError hashTableSetBatch(HashTable* table, const char* const* keys,
+                                          const size_t* lengths, size_t count);
+HashTableOperationError hashTableDelete(HashTable* table, const char* key, size_t length);
+
+const void* hashTableGetValue(HashTable* table, const char* key, size_t length);
+
+// Counts the key like hashTableSet and returns its value to be updated in
+// place, valid until the next insert. inserted tells a fresh zeroed value.
+void* hashTableUpsertValue(HashTable* table, const char* key, size_t length, bool* inserted);
+
+typedef void (*HashTableCombine)(void* value, const void* argument, bool inserted);
+
+HashTableOperationError hashTableUpsert(HashTable* table, const char* key, size_t length,
+                                        HashTableCombine combine, const void* argument);
+
+// Common combines over an int64_t at offset inside the value, a fresh value
+// always takes the argument. They are inline so a group-by that keeps
+// several aggregates can apply all of them after one hashTableUpsertValue.
+static inline int64_t hashTableLoadInt64(const void* value, size_t offset)
+{
+    int64_t current = 0;
+    memcpy(&current, (const char*)value + offset, sizeof(int64_t));
+
+    return current;
+}
+
+static inline void hashTableStoreInt64(void* value, size_t offset, int64_t current)
+{
+    memcpy((char*)value + offset, &current, sizeof(int64_t));
+}
+
+static inline void hashTableCombineAdd(void* value, size_t offset, int64_t argument, bool inserted)
+{
+    int64_t current = hashTableLoadInt64(value, offset);
+    hashTableStoreInt64(value, offset, inserted ? argument : current + argument);
+}
+
+static inline void hashTableCombineMin(void* value, size_t offset, int64_t argument, bool inserted)
+{
+    int64_t current = hashTableLoadInt64(value, offset);
+    hashTableStoreInt64(value, offset, inserted ? argument : argument < current ? argument : current);
+}
+
+static inline void hashTableCombineMax(void* value, size_t offset, int64_t argument, bool inserted)
+{
+    int64_t current = hashTableLoadInt64(value, offset);
+    hashTableStoreInt64(value, offset, inserted ? argument : argument > current ? argument : current);
+}
+
+static inline void hashTableCombineFirst(void* value, size_t offset, int64_t argument, bool inserted)
+{
+    if (inserted)
+    {
+        hashTableStoreInt64(value, offset, argument);
+    }
+}
+
+static inline void hashTableCombineLast(void* value, size_t offset, int64_t argument, bool inserted)
+{
+    (void)inserted;
+    hashTableStoreInt64(value, offset, argument);
+}
+
+HashTableOperationError hashTableUpsertAdd  (HashTable* table, const char* key, size_t length,
+                                             size_t offset, int64_t argument);
+HashTableOperationError hashTableUpsertMin  (HashTable* table, const char* key, size_t length,
+                                             size_t offset, int64_t argument);
+HashTableOperationError hashTableUpsertMax  (HashTable* table, const char* key, size_t length,
+                                             size_t offset, int64_t argument);
+HashTableOperationError hashTableUpsertFirst(HashTable* table, const char* key, size_t length,
+                                             size_t offset, int64_t argument);
+HashTableOperationError hashTableUpsertLast (HashTable* table, const char* key, size_t length,
+                                             size_t offset, int64_t argument);
 
 size_t hashTabelLength(HashTable* table);
 
+// One thread owns the table and does every call above, values are only
+// visible to it. Any number of other threads may read at the same time
+// through their own reader, they never block and never block the writer.
+typedef struct HashTableReader HashTableReader;
+
+HashTableReader* hashTableReaderRegister(HashTable* table);
+void hashTableReaderUnregister(HashTableReader* reader);
+size_t hashTableReaderGet(HashTableReader* reader, const char* key, size_t length);
+
 typedef struct HashTableIterator
 {
     const char* key;
     size_t      length;
     size_t      count;
+    const void* value;
 
     // this fields be addressed directly
     HashTable* _table;
-    size_t     _bucket_index;
-    size_t     _node_index;
+    size_t     _entry_index;
+    size_t     _entry_end;
 } HashTableIterator;
 
+// walks the keys in insertion order
 HashTableIterator hashTableIterator(HashTable* table);
+// walks one of slice_count disjoint parts, so threads can scan in parallel
+HashTableIterator hashTableIteratorSlice(HashTable* table, size_t slice, size_t slice_count);
 bool hashTableNext(HashTableIterator* iterator);
 
 #endif // HASH_TABLE_H
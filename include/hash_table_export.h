@@ -0,0 +1,34 @@
+#ifndef HASH_TABLE_EXPORT_H
+#define HASH_TABLE_EXPORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hash_table.h"
+
+typedef enum HashTableOrder
+{
+    HASH_TABLE_ORDER_KEY   = 0, // bytewise, shorter prefix first
+    HASH_TABLE_ORDER_COUNT = 1, // most frequent first, ties by key
+} HashTableOrder;
+
+typedef struct HashTableExportEntry
+{
+    const char* key;
+    size_t      length;
+    size_t      count;
+    const void* value;
+} HashTableExportEntry;
+
+// Gathers and sorts the table on all cores. out must hold
+// hashTabelLength(table) entries. Keys of a token table stay the raw spans
+// but sort as their words joined by single spaces.
+HashTableOperationError hashTableExportSorted(HashTable* table, HashTableOrder order,
+                                              HashTableExportEntry* out);
+
+// Writes "key count" lines in the given order, token keys with one space
+// between their words.
+HashTableOperationError hashTableExportSortedToFile(HashTable* table, HashTableOrder order,
+                                                    FILE* file);
+
+#endif // HASH_TABLE_EXPORT_H
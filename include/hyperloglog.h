@@ -0,0 +1,38 @@
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "text_processing.h"
+
+typedef enum HyperLogLogState
+{
+    HyperLogLogState_OK               = 0,
+    HyperLogLogState_ERROR            = 1,
+    HyperLogLogState_ALLOCATION_ERROR = 2,
+    HyperLogLogState_INVALID_INPUT    = 3,
+} HyperLogLogState;
+
+#define HYPERLOGLOG_MIN_PRECISION     4
+#define HYPERLOGLOG_MAX_PRECISION     18
+#define HYPERLOGLOG_DEFAULT_PRECISION 14
+
+typedef struct HyperLogLog
+{
+    uint8_t* registers;
+    size_t   register_count;
+    int      precision;
+} HyperLogLog;
+
+HyperLogLogState hyperLogLogCtor(HyperLogLog* counter, int precision);
+HyperLogLogState hyperLogLogDtor(HyperLogLog* counter);
+
+void hyperLogLogAdd(HyperLogLog* counter, const char* key, size_t length);
+size_t hyperLogLogEstimate(const HyperLogLog* counter);
+
+// counts every sample_stride-th word of the text, 1 scans all of it;
+// sampling misses rare words so the result is a lower bound
+size_t hyperLogLogEstimateText(Text* text, int precision, size_t sample_stride);
+
+#endif // HYPERLOGLOG_H
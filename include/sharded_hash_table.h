@@ -0,0 +1,51 @@
+#ifndef SHARDED_HASH_TABLE_H
+#define SHARDED_HASH_TABLE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "hash_table.h"
+
+// Keys are split between shards by the high bits of their mixed hash. Every
+// shard is owned by a worker thread pinned to one NUMA node, which creates
+// the shard and does all its writes, so the shard memory is first touched
+// and stays on that node. A host with a single node gets one shard per CPU
+// instead, each worker pinned to its own CPU.
+typedef struct ShardedHashTable ShardedHashTable;
+
+typedef enum ShardedOperationType
+{
+    ShardedOperation_GET    = 0,
+    ShardedOperation_SET    = 1,
+    ShardedOperation_DELETE = 2,
+} ShardedOperationType;
+
+typedef struct ShardedOperation
+{
+    ShardedOperationType type;
+    const char*          key;
+    size_t               length;
+} ShardedOperation;
+
+// shard_count 0 picks one shard per node, or one per CPU on a single node
+ShardedHashTable* shardedHashTableCtor(size_t shard_count, size_t expected_length);
+HashTableOperationError shardedHashTableDtor(ShardedHashTable* table);
+
+HashTableOperationError shardedHashTableSetKeyBase(ShardedHashTable* table, const char* key_base);
+
+// Hands every operation to the worker of its shard and waits for all of them.
+// Each shard runs its operations in the given order. results, if given,
+// receives the count of every GET. Only one thread may call this at a time.
+HashTableOperationError shardedHashTableApply(ShardedHashTable* table,
+                                              const ShardedOperation* operations,
+                                              size_t count, size_t* results);
+
+size_t shardedHashTableLength(ShardedHashTable* table);
+size_t shardedHashTableShardCount(ShardedHashTable* table);
+
+// Direct access skips the routing. The caller then owns the shard and should
+// run on its node; no Apply may run at the same time.
+size_t shardedHashTableShardOf(ShardedHashTable* table, const char* key, size_t length);
+HashTable* shardedHashTableShard(ShardedHashTable* table, size_t index);
+
+#endif // SHARDED_HASH_TABLE_H
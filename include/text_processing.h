@@ -3,6 +3,10 @@
 
 #include <stdlib.h>
 
+#include "hash_table.h"
+
+#define TEXT_MAX_NGRAM 8
+
 typedef enum TextState
 {
     TextState_OK                 = 0,
@@ -22,6 +26,11 @@ TextState textLoad(Text* text, const char* filename);
 int textPutNextWordToBuffer(Text* text, char* buffer, size_t buffer_size);
 int textNextWordPointer(Text* text, char** pointer);
 TextState textMoveToBegin(Text* text);
+// Counts every run of n consecutive words from the current position on.
+// Keys point into the text and span the words with the whitespace between
+// them, so table is switched to token mode (hashTableSetTokenKeys); a
+// non-empty table must already be in it.
+TextState textCountNgrams(Text* text, HashTable* table, size_t n);
 TextState textDtor(Text* text);
 
 #endif // TEXT_PROCESSING_H
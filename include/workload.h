@@ -0,0 +1,72 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef enum WorkloadState
+{
+    WorkloadState_OK               = 0,
+    WorkloadState_ERROR            = 1,
+    WorkloadState_ALLOCATION_ERROR = 2,
+    WorkloadState_INVALID_CONFIG   = 3,
+} WorkloadState;
+
+typedef enum WorkloadOperationType
+{
+    WorkloadOperation_GET    = 0,
+    WorkloadOperation_SET    = 1,
+    WorkloadOperation_DELETE = 2,
+} WorkloadOperationType;
+
+typedef enum WorkloadLengthDistribution
+{
+    WorkloadLength_UNIFORM   = 0, // uniform in [min_key_length, max_key_length]
+    WorkloadLength_GEOMETRIC = 1, // geometric around mean_key_length, clamped
+} WorkloadLengthDistribution;
+
+typedef struct WorkloadConfig
+{
+    uint64_t seed;
+
+    size_t vocabulary_size;
+    size_t operation_count;
+
+    // 0 is uniform, ~1 is natural language
+    double zipf_skew;
+
+    WorkloadLengthDistribution length_distribution;
+    size_t min_key_length;
+    size_t max_key_length;
+    double mean_key_length;
+
+    // must sum up to 100
+    unsigned get_percent;
+    unsigned set_percent;
+    unsigned delete_percent;
+} WorkloadConfig;
+
+typedef struct WorkloadOperation
+{
+    uint32_t type;
+    uint32_t key_index;
+} WorkloadOperation;
+
+typedef struct Workload
+{
+    // random keys, all distinct, so every zipf rank has a key of its own
+    char*        key_arena;
+    const char** keys;
+    size_t*      key_lengths;
+    size_t       key_count;
+
+    WorkloadOperation* operations;
+    size_t             operation_count;
+} Workload;
+
+WorkloadConfig workloadDefaultConfig(void);
+
+WorkloadState workloadGenerate(Workload* workload, const WorkloadConfig* config);
+WorkloadState workloadDtor(Workload* workload);
+
+#endif // WORKLOAD_H
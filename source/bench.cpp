@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "hash_table.h"
+#include "sharded_hash_table.h"
+#include "workload.h"
+
+
+#define SHARDED_BATCH_SIZE 256
+
+typedef struct BenchResult
+{
+    size_t   gets;
+    size_t   hits;
+    uint64_t total_time; // wall clock of the whole replay loop
+    size_t   table_size;
+} BenchResult;
+
+static bool replay(const Workload* workload, bool prefill, uint64_t* latencies,
+                   BenchResult* result);
+static bool replaySharded(const Workload* workload, size_t shard_count, bool prefill,
+                          uint64_t* latencies, BenchResult* result);
+static uint64_t nowNanoseconds(void);
+static int compareLatencies(const void* first, const void* second);
+static bool parseArguments(int argc, char** argv, WorkloadConfig* config, bool* prefill,
+                           bool* sharded, size_t* shard_count);
+static void printUsage(const char* program);
+
+
+int main(int argc, char** argv)
+{
+    WorkloadConfig config = workloadDefaultConfig();
+    bool prefill = true;
+    bool sharded = false;
+    size_t shard_count = 0;
+
+    if (!parseArguments(argc, argv, &config, &prefill, &sharded, &shard_count))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Workload workload = {};
+    if (workloadGenerate(&workload, &config) != WorkloadState_OK)
+    {
+        fprintf(stderr, "Could not generate workload\n");
+        return 1;
+    }
+
+    uint64_t* latencies = (uint64_t*)calloc(workload.operation_count, sizeof(uint64_t));
+    if (!latencies)
+    {
+        fprintf(stderr, "Could not allocate latency buffer\n");
+        workloadDtor(&workload);
+        return 1;
+    }
+
+    BenchResult result = {};
+    bool replayed = sharded ? replaySharded(&workload, shard_count, prefill, latencies, &result)
+                            : replay(&workload, prefill, latencies, &result);
+    if (!replayed)
+    {
+        free(latencies);
+        workloadDtor(&workload);
+        return 1;
+    }
+
+    qsort(latencies, workload.operation_count, sizeof(uint64_t), compareLatencies);
+
+    size_t count = workload.operation_count;
+    printf("operations  %zu (%u%% get / %u%% set / %u%% delete, skew %.2f, %zu keys)\n",
+           count, config.get_percent, config.set_percent, config.delete_percent,
+           config.zipf_skew, workload.key_count);
+    printf("throughput  %.2f Mops/s\n", result.total_time ? count * 1e3 / result.total_time : 0.0);
+    printf("hit rate    %.2f%% of gets\n", result.gets ? result.hits * 100.0 / result.gets : 0.0);
+    if (count)
+    {
+        printf("latency ns  p50 %lu  p90 %lu  p99 %lu  p99.9 %lu  max %lu%s\n",
+               latencies[count * 50  / 100],
+               latencies[count * 90  / 100],
+               latencies[count * 99  / 100],
+               latencies[count * 999 / 1000],
+               latencies[count - 1],
+               sharded ? "  (batch averages)" : "");
+    }
+    printf("table size  %zu\n", result.table_size);
+
+    free(latencies);
+    workloadDtor(&workload);
+    return 0;
+}
+
+
+static bool replay(const Workload* workload, bool prefill, uint64_t* latencies,
+                   BenchResult* result)
+{
+    HashTable* hash_table = hashTableCtor();
+    if (!hash_table)
+    {
+        return false;
+    }
+
+    hashTableSetKeyBase(hash_table, workload->key_arena);
+
+    if (prefill)
+    {
+        for (size_t i = 0; i < workload->key_count; i++)
+        {
+            hashTableSet(hash_table, workload->keys[i], workload->key_lengths[i]);
+        }
+    }
+
+    // per operation samples only feed the percentiles, throughput comes
+    // from the loop as a whole so the clock reads are not left out
+    uint64_t replay_start = nowNanoseconds();
+    for (size_t i = 0; i < workload->operation_count; i++)
+    {
+        WorkloadOperation* operation = &workload->operations[i];
+        const char* key    = workload->keys[operation->key_index];
+        size_t      length = workload->key_lengths[operation->key_index];
+
+        uint64_t start = nowNanoseconds();
+        switch (operation->type)
+        {
+            case WorkloadOperation_GET:
+                result->gets++;
+                result->hits += hashTableGet(hash_table, key, length) != 0;
+                break;
+            case WorkloadOperation_SET:
+                hashTableSet(hash_table, key, length);
+                break;
+            case WorkloadOperation_DELETE:
+                hashTableDelete(hash_table, key, length);
+                break;
+            default:
+                break;
+        }
+        latencies[i] = nowNanoseconds() - start;
+    }
+    result->total_time = nowNanoseconds() - replay_start;
+
+    result->table_size = hashTabelLength(hash_table);
+    hashTableDtor(hash_table);
+
+    return true;
+}
+
+
+// operations go to the shards in batches, every operation of a batch is
+// charged the batch average
+static bool replaySharded(const Workload* workload, size_t shard_count, bool prefill,
+                          uint64_t* latencies, BenchResult* result)
+{
+    ShardedHashTable* hash_table = shardedHashTableCtor(shard_count, workload->key_count);
+    if (!hash_table)
+    {
+        return false;
+    }
+
+    shardedHashTableSetKeyBase(hash_table, workload->key_arena);
+
+    ShardedOperation batch[SHARDED_BATCH_SIZE] = {};
+    size_t counts[SHARDED_BATCH_SIZE] = {};
+
+    for (size_t begin = 0; prefill && begin < workload->key_count; begin += SHARDED_BATCH_SIZE)
+    {
+        size_t batch_size = workload->key_count - begin < SHARDED_BATCH_SIZE
+                          ? workload->key_count - begin : SHARDED_BATCH_SIZE;
+        for (size_t i = 0; i < batch_size; i++)
+        {
+            batch[i] = {
+                .type   = ShardedOperation_SET,
+                .key    = workload->keys[begin + i],
+                .length = workload->key_lengths[begin + i],
+            };
+        }
+        shardedHashTableApply(hash_table, batch, batch_size, NULL);
+    }
+
+    uint64_t replay_start = nowNanoseconds();
+    for (size_t begin = 0; begin < workload->operation_count; begin += SHARDED_BATCH_SIZE)
+    {
+        size_t batch_size = workload->operation_count - begin < SHARDED_BATCH_SIZE
+                          ? workload->operation_count - begin : SHARDED_BATCH_SIZE;
+        for (size_t i = 0; i < batch_size; i++)
+        {
+            WorkloadOperation* operation = &workload->operations[begin + i];
+            batch[i] = {
+                .type   = (ShardedOperationType)operation->type,
+                .key    = workload->keys[operation->key_index],
+                .length = workload->key_lengths[operation->key_index],
+            };
+            counts[i] = 0;
+        }
+
+        uint64_t start = nowNanoseconds();
+        shardedHashTableApply(hash_table, batch, batch_size, counts);
+        uint64_t time = nowNanoseconds() - start;
+
+        for (size_t i = 0; i < batch_size; i++)
+        {
+            result->gets += batch[i].type == ShardedOperation_GET;
+            result->hits += batch[i].type == ShardedOperation_GET && counts[i] != 0;
+            latencies[begin + i] = time / batch_size;
+        }
+    }
+    result->total_time = nowNanoseconds() - replay_start;
+
+    result->table_size = shardedHashTableLength(hash_table);
+    shardedHashTableDtor(hash_table);
+
+    return true;
+}
+
+
+static uint64_t nowNanoseconds(void)
+{
+    struct timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+
+static int compareLatencies(const void* first, const void* second)
+{
+    uint64_t a = *(const uint64_t*)first;
+    uint64_t b = *(const uint64_t*)second;
+
+    return (a > b) - (a < b);
+}
+
+
+static bool parseArguments(int argc, char** argv, WorkloadConfig* config, bool* prefill,
+                           bool* sharded, size_t* shard_count)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* option = argv[i];
+        const char* value  = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!strcmp(option, "--no-prefill"))
+        {
+            *prefill = false;
+            continue;
+        }
+
+        if (!value)
+        {
+            return false;
+        }
+        i++;
+
+        if      (!strcmp(option, "--seed"))        config->seed            = strtoull(value, NULL, 10);
+        else if (!strcmp(option, "--keys"))        config->vocabulary_size = strtoull(value, NULL, 10);
+        else if (!strcmp(option, "--ops"))         config->operation_count = strtoull(value, NULL, 10);
+        else if (!strcmp(option, "--skew"))        config->zipf_skew       = strtod(value, NULL);
+        else if (!strcmp(option, "--min-length"))  config->min_key_length  = strtoull(value, NULL, 10);
+        else if (!strcmp(option, "--max-length"))  config->max_key_length  = strtoull(value, NULL, 10);
+        else if (!strcmp(option, "--mean-length")) config->mean_key_length = strtod(value, NULL);
+        else if (!strcmp(option, "--shards"))
+        {
+            *sharded     = true;
+            *shard_count = strtoull(value, NULL, 10);
+        }
+        else if (!strcmp(option, "--lengths"))
+        {
+            if      (!strcmp(value, "uniform"))   config->length_distribution = WorkloadLength_UNIFORM;
+            else if (!strcmp(value, "geometric")) config->length_distribution = WorkloadLength_GEOMETRIC;
+            else return false;
+        }
+        else if (!strcmp(option, "--mix"))
+        {
+            if (sscanf(value, "%u/%u/%u", &config->get_percent,
+                                          &config->set_percent,
+                                          &config->delete_percent) != 3)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void printUsage(const char* program)
+{
+    fprintf(stderr,
+            "Usage: %s [--seed N] [--keys N] [--ops N] [--skew S] [--mix GET/SET/DELETE]\n"
+            "          [--lengths uniform|geometric] [--min-length N] [--max-length N]\n"
+            "          [--mean-length N] [--no-prefill] [--shards N, 0 for auto]\n",
+            program);
+}
@@ -0,0 +1,198 @@
+#include "hash_function.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <immintrin.h>
+#include <assert.h>
+
+
+// static ----------------------------------------------------------------------
+
+
+#define DJB2_SEED  5381
+#define DJB2_BASE  33
+#define BLOCK_SIZE 4
+#define PAGE_SIZE  4096
+
+static void hashBlock(__m256i* hash, __m256i block, __m256i block_length);
+
+
+// public ----------------------------------------------------------------------
+
+
+uint64_t hashString(const char* data, size_t length)
+{
+    assert(data != NULL);
+
+    uint64_t hash = DJB2_SEED;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)data[i];
+    }
+
+    return hash;
+}
+
+
+HashStringPart hashStringPart(const char* data, size_t length)
+{
+    assert(data != NULL);
+
+    HashStringPart part = { .sum = 0, .power = 1 };
+    for (size_t i = 0; i < length; i++)
+    {
+        part.sum    = part.sum * DJB2_BASE + (unsigned char)data[i];
+        part.power *= DJB2_BASE;
+    }
+
+    return part;
+}
+
+
+HashStringPart hashStringJoin(HashStringPart first, HashStringPart second)
+{
+    return {
+        .sum   = first.sum * second.power + second.sum,
+        .power = first.power * second.power,
+    };
+}
+
+
+uint64_t hashStringFinish(HashStringPart part)
+{
+    return DJB2_SEED * part.power + part.sum;
+}
+
+
+uint64_t hashStringTokens(const char* data, size_t length)
+{
+    assert(data != NULL);
+
+    uint64_t hash = DJB2_SEED;
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char byte = (unsigned char)data[i];
+        if (isspace(byte))
+        {
+            while (i + 1 < length && isspace((unsigned char)data[i + 1]))
+            {
+                i++;
+            }
+            byte = ' ';
+        }
+
+        hash = ((hash << 5) + hash) + byte;
+    }
+
+    return hash;
+}
+
+
+void hashString8(const char* const* keys, const size_t* lengths, uint32_t* hashes)
+{
+    assert(keys    != NULL);
+    assert(lengths != NULL);
+    assert(hashes  != NULL);
+
+    size_t max_length = 0;
+    alignas(32) int key_lengths[HASH_STRING_LANES] = {};
+    for (int lane = 0; lane < HASH_STRING_LANES; lane++)
+    {
+        max_length = lengths[lane] > max_length ? lengths[lane] : max_length;
+        key_lengths[lane] = (int)lengths[lane];
+    }
+
+    __m256i hash   = _mm256_set1_epi32(DJB2_SEED);
+    __m256i length = _mm256_load_si256((const __m256i*)key_lengths);
+
+    __m256i address_low  = _mm256_loadu_si256((const __m256i*)keys);
+    __m256i address_high = _mm256_loadu_si256((const __m256i*)(keys + 4));
+
+    __m256i zero        = _mm256_setzero_si256();
+    __m256i full_block  = _mm256_set1_epi32(BLOCK_SIZE);
+    __m256i page_mask   = _mm256_set1_epi64x(PAGE_SIZE - 1);
+    __m256i page_border = _mm256_set1_epi64x(PAGE_SIZE - BLOCK_SIZE);
+
+    // 64-bit address lanes in the order of the packed 32-bit lanes
+    __m256i pack_order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    for (size_t offset = 0; offset < max_length; offset += BLOCK_SIZE)
+    {
+        __m256i block_low_address  = _mm256_add_epi64(address_low,  _mm256_set1_epi64x((long long)offset));
+        __m256i block_high_address = _mm256_add_epi64(address_high, _mm256_set1_epi64x((long long)offset));
+
+        __m256i remaining    = _mm256_sub_epi32(length, _mm256_set1_epi32((int)offset));
+        __m256i block_length = _mm256_min_epi32(remaining, full_block);
+        __m256i active       = _mm256_cmpgt_epi32(block_length, zero);
+
+        // a whole block is read even when the key ends inside it, hashBlock
+        // ignores the extra bytes; only a read that would cross into the next
+        // page is done by hand
+        __m256i crossing_low  = _mm256_cmpgt_epi64(_mm256_and_si256(block_low_address,  page_mask),
+                                                   page_border);
+        __m256i crossing_high = _mm256_cmpgt_epi64(_mm256_and_si256(block_high_address, page_mask),
+                                                   page_border);
+        __m256i crossing = _mm256_permutevar8x32_epi32(
+            _mm256_blend_epi32(crossing_low, _mm256_slli_epi64(crossing_high, 32), 0xAA),
+            pack_order
+        );
+
+        __m256i unsafe = _mm256_and_si256(_mm256_and_si256(active, crossing),
+                                          _mm256_cmpgt_epi32(full_block, block_length));
+
+        int unsafe_lanes = _mm256_movemask_ps(_mm256_castsi256_ps(unsafe));
+
+        alignas(32) int tails[HASH_STRING_LANES] = {};
+        for (int lane = 0; unsafe_lanes && lane < HASH_STRING_LANES; lane++)
+        {
+            if (unsafe_lanes & (1 << lane))
+            {
+                memcpy(&tails[lane], keys[lane] + offset, lengths[lane] - offset);
+            }
+        }
+
+        __m256i gather_mask = _mm256_andnot_si256(unsafe, active);
+        __m256i tail_blocks = _mm256_load_si256((const __m256i*)tails);
+
+        __m128i block_low = _mm256_mask_i64gather_epi32(
+            _mm256_castsi256_si128(tail_blocks),
+            (const int*)NULL,
+            block_low_address,
+            _mm256_castsi256_si128(gather_mask),
+            1
+        );
+        __m128i block_high = _mm256_mask_i64gather_epi32(
+            _mm256_extracti128_si256(tail_blocks, 1),
+            (const int*)NULL,
+            block_high_address,
+            _mm256_extracti128_si256(gather_mask, 1),
+            1
+        );
+
+        hashBlock(&hash, _mm256_set_m128i(block_high, block_low), block_length);
+    }
+
+    _mm256_storeu_si256((__m256i*)hashes, hash);
+}
+
+
+// static ----------------------------------------------------------------------
+
+
+static void hashBlock(__m256i* hash, __m256i block, __m256i block_length)
+{
+    assert(hash != NULL);
+
+    __m256i byte_mask = _mm256_set1_epi32(0xFF);
+
+    for (int i = 0; i < BLOCK_SIZE; i++)
+    {
+        __m256i byte = _mm256_and_si256(_mm256_srli_epi32(block, 8 * i), byte_mask);
+
+        // lanes whose key already ended keep their hash
+        __m256i active = _mm256_cmpgt_epi32(block_length, _mm256_set1_epi32(i));
+        __m256i step   = _mm256_add_epi32(_mm256_slli_epi32(*hash, 5), byte);
+
+        *hash = _mm256_add_epi32(*hash, _mm256_and_si256(step, active));
+    }
+}
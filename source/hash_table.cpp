@@ -3,31 +3,162 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
-#include "list.h"
+#include "hash_function.h"
 
 
 // static ----------------------------------------------------------------------
 
 
 #define INITIAL_CAPACITY 2
-#define LIST_INITIAL_CAPACITY 1000
 #define LOAD_FACTOR 2
 #define SCALE_FACTOR 2
 
+#define NO_ENTRY -1
+#define QUIESCENT_EPOCH 0
+#define VALUE_ALIGNMENT 8
+#define CACHE_LINE_SIZE 64
 
-typedef struct HashTable
+
+// Entries live in one dense array in insertion order, buckets only hold the
+// index of the first entry of their chain. Deleted entries keep their slot
+// with zero count until the storage is rebuilt.
+#ifdef HASH_TABLE_COMPACT_ENTRIES
+
+// Keys are offsets from the table key base and only the high half of the
+// hash is kept as a tag, so rebuilds have to rehash the keys.
+#define MAX_KEY_OFFSET UINT32_MAX
+#define MAX_KEY_LENGTH UINT16_MAX
+
+typedef struct Entry
+{
+    uint32_t key_offset;
+    int      count;
+    int      next;
+    uint16_t length;
+    uint16_t hash_tag;
+} Entry;
+
+static_assert(sizeof(Entry) == 16, "compact entry must stay 16 bytes");
+
+#else
+
+typedef struct Entry
+{
+    const char* key_pointer;
+    int         length;
+    int         count;
+    uint32_t    hash;
+    int         next;
+} Entry;
+
+#endif
+
+
+// Buckets, entries and their values of one generation share a single
+// allocation. The writer never moves anything inside a published storage:
+// growing or compacting builds a new one, publishes it and retires the old one
+// until no reader can still be inside it.
+typedef struct Storage
 {
-    List*  buckets;
     size_t capacity;
+    size_t entries_capacity;
+    int*   buckets;
+    Entry* entries;
+    char*  values;
+
+    struct Storage* retired_next;
+    uint64_t        retired_epoch;
+} Storage;
+
+
+// Every lookup stores to epoch, so each reader gets a cache line of its own
+// to keep readers on different cores from invalidating each other.
+typedef struct alignas(CACHE_LINE_SIZE) HashTableReader
+{
+    HashTable* table;
+    uint64_t   epoch;
+    bool       in_use;
+
+    struct HashTableReader* next;
+} HashTableReader;
+
+static_assert(sizeof(HashTableReader) == CACHE_LINE_SIZE, "reader must fill one cache line");
+
+
+// An evicted key handed back to the caller once no reader can compare it,
+// through the callback it was evicted under even if the limits changed since.
+typedef struct EvictedKey
+{
+    const char*    key;
+    size_t         length;
+    size_t         count;
+    uint64_t       epoch;
+    HashTableEvict evict;
+    void*          evict_argument;
+} EvictedKey;
+
+
+typedef struct HashTable
+{
+    // Every reader lookup loads these, the writer only changes them on a
+    // rebuild or a retire. They get a cache line of their own so that the
+    // counters below, bumped on every insert, do not invalidate it.
+    alignas(CACHE_LINE_SIZE) Storage* storage;
+    uint64_t    epoch;
+    const char* key_base;
+    bool        token_keys;
+
+    alignas(CACHE_LINE_SIZE) size_t entries_used;
     size_t length;
+
+    size_t value_size;
+    size_t value_stride;
+
+    // cache mode, zero limits mean unbounded
+    size_t         max_entries;
+    size_t         max_bytes;
+    size_t         bytes;
+    size_t         clock_hand;
+    HashTableEvict evict;
+    void*          evict_argument;
+
+    EvictedKey* evicted;
+    size_t      evicted_count;
+    size_t      evicted_capacity;
+
+    HashTableReader* readers;
+    Storage*         retired;
 } HashTable;
 
 
-static size_t hashFunction(const char* data, size_t length, size_t capacity);
-static HashTableOperationError hashTableResize(HashTable* table);
+static size_t capacityForLength(size_t length);
+static uint64_t hashTableHash(const HashTable* table, const char* key, size_t length);
+static bool keysEqual(const HashTable* table, const char* first, size_t first_length,
+                      const char* second, size_t second_length);
+static bool isEntryDeleted(const Entry* entry);
+static const char* entryKey(const HashTable* table, const Entry* entry);
+static uint32_t entryHash(const HashTable* table, const Entry* entry);
+static bool entryMatches(const HashTable* table, const Entry* entry,
+                         const char* key, size_t length, uint64_t hash);
+static bool entryInit(const HashTable* table, Entry* entry,
+                      const char* key, size_t length, uint64_t hash);
+static Entry* hashTableSetHashed(HashTable* table, const char* key, size_t length,
+                                 uint64_t hash, bool* inserted);
+static void* hashTableEntryValue(HashTable* table, Entry* entry);
+static Entry* hashTableFind(HashTable* table, const char* key, size_t length, uint64_t hash);
+static size_t entryBytes(const HashTable* table, size_t length);
+static void hashTableRemoveEntry(HashTable* table, int* link, Entry* entry);
+static bool hashTableOverLimit(const HashTable* table, size_t new_bytes);
+static void hashTableEvictOne(HashTable* table);
+static void hashTableReleaseKey(HashTable* table, const char* key, size_t length, size_t count);
+static Storage* storageCtor(size_t capacity, size_t value_stride);
+static HashTableOperationError hashTableRebuild(HashTable* table, size_t new_capacity);
+static void hashTableRetire(HashTable* table, Storage* storage);
+static void hashTableReclaim(HashTable* table);
 
 
 // public ----------------------------------------------------------------------
@@ -35,42 +166,40 @@ static HashTableOperationError hashTableResize(HashTable* table);
 
 HashTable* hashTableCtor(void)
 {
-    HashTable* table = (HashTable*)calloc(1, sizeof(HashTable));
+    return hashTableCtorWithHint(0);
+}
+
+
+HashTable* hashTableCtorWithHint(size_t expected_length)
+{
+    return hashTableCtorWithValues(expected_length, 0);
+}
+
+
+HashTable* hashTableCtorWithValues(size_t expected_length, size_t value_size)
+{
+    HashTable* table = (HashTable*)aligned_alloc(CACHE_LINE_SIZE, sizeof(HashTable));
     if (!table)
     {
         fprintf(stderr, "Error while allocating memory for table struct\n");
-        return NULL; 
+        return NULL;
     }
+    memset(table, 0, sizeof(HashTable));
+
+    table->length = 0;
+    table->epoch  = QUIESCENT_EPOCH + 1;
 
-    table->length   = 0;
-    table->capacity = INITIAL_CAPACITY;
+    table->value_size   = value_size;
+    table->value_stride = (value_size + VALUE_ALIGNMENT - 1) / VALUE_ALIGNMENT * VALUE_ALIGNMENT;
 
-    table->buckets = (List*)calloc(table->capacity, 
-                                   sizeof(List));
-    if (!table->buckets)
+    table->storage = storageCtor(capacityForLength(expected_length), table->value_stride);
+    if (!table->storage)
     {
         fprintf(stderr, "Error while creating hash table entries\n");
         free(table);
         return NULL;
     }
 
-    for (int i = 0; i < INITIAL_CAPACITY; i++)
-    {
-        if(listCtor(&table->buckets[i], LIST_INITIAL_CAPACITY) != ListOperationError_SUCCESS)
-        {
-            fprintf(stderr, "Error while ctor\n");
-
-            for (int j = 0; j <= i; j++)
-            {
-                listDtor(&table->buckets[j]);
-            }
-
-            free(table->buckets);
-            free(table);
-            return NULL;
-        }
-    }
-
     return table;
 }
 
@@ -80,98 +209,196 @@ HashTableOperationError hashTableDtor(HashTable* table)
     if (!table)
     {
         fprintf(stderr, "Empty pointer on table while destroing\n");
-        return HASH_TABLE_ERROR; 
+        return HASH_TABLE_ERROR;
     }
 
-    for (size_t i = 0; i < table->capacity; i++)
+    for (size_t i = 0; i < table->evicted_count; i++)
     {
-        listDtor(&table->buckets[i]);
+        EvictedKey* evicted = &table->evicted[i];
+        evicted->evict(evicted->key, evicted->length, evicted->count, evicted->evict_argument);
     }
+    free(table->evicted);
 
-    free(table->buckets);
+    while (table->retired)
+    {
+        Storage* next = table->retired->retired_next;
+        free(table->retired);
+        table->retired = next;
+    }
+
+    while (table->readers)
+    {
+        HashTableReader* next = table->readers->next;
+        free(table->readers);
+        table->readers = next;
+    }
+
+    free(table->storage);
     free(table);
 
     return HASH_TABLE_SUCCESS;
 }
 
 
+HashTableOperationError hashTableReserve(HashTable* table, size_t length)
+{
+    assert(table != NULL);
+
+    size_t new_capacity = capacityForLength(length);
+    if (new_capacity <= table->storage->capacity)
+    {
+        return HASH_TABLE_SUCCESS;
+    }
+
+    return hashTableRebuild(table, new_capacity);
+}
+
+
 const char* hashTableSet(HashTable* table, const char* key, size_t length)
 {
     assert(table != NULL);
     assert(key   != NULL);
 
-    if ((double)table->length / table->capacity > LOAD_FACTOR)
+    return hashTableSetWithHash(table, key, length, hashTableHash(table, key, length));
+}
+
+
+const char* hashTableSetWithHash(HashTable* table, const char* key, size_t length, uint64_t hash)
+{
+    assert(table != NULL);
+    assert(key   != NULL);
+
+    bool inserted = false;
+    Entry* entry = hashTableSetHashed(table, key, length, hash, &inserted);
+
+    return entry ? entryKey(table, entry) : NULL;
+}
+
+
+HashTableOperationError hashTableSetBatch(HashTable* table, const char* const* keys,
+                                          const size_t* lengths, size_t count)
+{
+    assert(table   != NULL);
+    assert(keys    != NULL);
+    assert(lengths != NULL);
+
+    uint32_t hashes[HASH_STRING_LANES] = {};
+    bool inserted = false;
+
+    // the vector kernel only knows the plain hash
+    size_t index = 0;
+    for (; !table->token_keys && index + HASH_STRING_LANES <= count; index += HASH_STRING_LANES)
     {
-        if (hashTableResize(table) != HASH_TABLE_SUCCESS)
+        hashString8(keys + index, lengths + index, hashes);
+
+        for (size_t lane = 0; lane < HASH_STRING_LANES; lane++)
         {
-            fprintf(stderr, "Error while resizing hash table\n");
-            return NULL; 
+            if (!hashTableSetHashed(table, keys[index + lane], lengths[index + lane],
+                                    hashes[lane], &inserted))
+            {
+                return HASH_TABLE_ERROR;
+            }
         }
     }
 
-    size_t index = hashFunction(key, length, table->capacity);
-    List* list = &table->buckets[index];
-    if (list->size != 0)
+    for (; index < count; index++)
     {
-        Node* node_array = list->node_array;
-
-        size_t current_index = node_array[0].next;
-        while (current_index != 0)
+        if (!hashTableSet(table, keys[index], lengths[index]))
         {
-            NodeData* node_data = &list->data[current_index];
-            Node* node = &node_array[current_index];
-            if (!memcmp(node_data->key_pointer, key, length))
-            {
-                node_data->count++;
-                return node_data->key_pointer;
-            }
-            current_index = node->next;
+            return HASH_TABLE_ERROR;
         }
     }
 
-    int new_node_index = listInsertTail(list);
-    if (new_node_index == 0)
+    return HASH_TABLE_SUCCESS;
+}
+
+
+void* hashTableUpsertValue(HashTable* table, const char* key, size_t length, bool* inserted)
+{
+    assert(table    != NULL);
+    assert(key      != NULL);
+    assert(inserted != NULL);
+
+    uint64_t hash = hashTableHash(table, key, length);
+    Entry* entry = hashTableSetHashed(table, key, length, hash, inserted);
+    if (!entry)
     {
-        fprintf(stderr, "Error while inserting\n");
         return NULL;
     }
 
-    NodeData* new_node = &list->data[new_node_index];
+    return hashTableEntryValue(table, entry);
+}
 
-    new_node->key_pointer = key;
-    new_node->length      = length;
-    new_node->count       = 1; 
 
-    table->length++;
-    return key;
+HashTableOperationError hashTableUpsert(HashTable* table, const char* key, size_t length,
+                                        HashTableCombine combine, const void* argument)
+{
+    assert(table   != NULL);
+    assert(key     != NULL);
+    assert(combine != NULL);
+
+    bool inserted = false;
+    void* value = hashTableUpsertValue(table, key, length, &inserted);
+    if (!value)
+    {
+        return HASH_TABLE_ERROR;
+    }
+
+    combine(value, argument, inserted);
+
+    return HASH_TABLE_SUCCESS;
 }
 
 
+#define DEFINE_UPSERT(name)                                                           \
+    HashTableOperationError hashTableUpsert##name(HashTable* table, const char* key,   \
+                                                  size_t length, size_t offset,        \
+                                                  int64_t argument)                    \
+    {                                                                                  \
+        assert(offset + sizeof(int64_t) <= table->value_size);                         \
+                                                                                       \
+        bool inserted = false;                                                         \
+        void* value = hashTableUpsertValue(table, key, length, &inserted);             \
+        if (!value)                                                                    \
+        {                                                                              \
+            return HASH_TABLE_ERROR;                                                   \
+        }                                                                              \
+                                                                                       \
+        hashTableCombine##name(value, offset, argument, inserted);                     \
+                                                                                       \
+        return HASH_TABLE_SUCCESS;                                                     \
+    }
+
+DEFINE_UPSERT(Add)
+DEFINE_UPSERT(Min)
+DEFINE_UPSERT(Max)
+DEFINE_UPSERT(First)
+DEFINE_UPSERT(Last)
+
+#undef DEFINE_UPSERT
+
+
 HashTableOperationError hashTableDelete(HashTable* table, const char* key, size_t length)
 {
     assert(table != NULL);
     assert(key   != NULL);
 
-    size_t index = hashFunction(key, length, table->capacity);
-    List* list = &table->buckets[index];
-    Node* node_array = list->node_array;
+    uint64_t hash = hashTableHash(table, key, length);
+    Storage* storage = table->storage;
 
-    size_t current_index = node_array[0].next;
-    while (current_index != 0)
+    int* link = &storage->buckets[hash & (storage->capacity - 1)];
+    while (*link != NO_ENTRY)
     {
-        Node* node = &node_array[current_index];
-        NodeData* node_data = &list->data[current_index];
-        if (!memcmp(node_data->key_pointer, key, length))
+        Entry* entry = &storage->entries[*link];
+        if (entryMatches(table, entry, key, length, hash))
         {
-            listDeleteElement(list, current_index);
-            break;
+            hashTableRemoveEntry(table, link, entry);
+            return HASH_TABLE_SUCCESS;
         }
-        current_index = node->next;
+        link = &entry->next;
     }
 
-    table->length--;
-
-    return HASH_TABLE_SUCCESS;
+    return HASH_TABLE_KEY_NOT_FOUND;
 }
 
 
@@ -180,38 +407,204 @@ size_t hashTableGet(HashTable* table, const char* key, size_t length)
     assert(table != NULL);
     assert(key   != NULL);
 
-    size_t index = hashFunction(key, length, table->capacity);
-    List* list = &table->buckets[index];
-    Node* node_array = list->node_array;
+    return hashTableGetWithHash(table, key, length, hashTableHash(table, key, length));
+}
+
 
-    size_t current_index = node_array[0].next;
-    while (current_index != 0)
+size_t hashTableGetWithHash(HashTable* table, const char* key, size_t length, uint64_t hash)
+{
+    assert(table != NULL);
+    assert(key   != NULL);
+
+    Entry* entry = hashTableFind(table, key, length, hash);
+
+    return entry ? entry->count : 0;
+}
+
+
+const void* hashTableGetValue(HashTable* table, const char* key, size_t length)
+{
+    assert(table != NULL);
+    assert(key   != NULL);
+
+    Entry* entry = hashTableFind(table, key, length, hashTableHash(table, key, length));
+
+    return entry ? hashTableEntryValue(table, entry) : NULL;
+}
+
+
+HashTableOperationError hashTableSetCacheLimit(HashTable* table, size_t max_entries,
+                                               size_t max_bytes, HashTableEvict evict,
+                                               void* argument)
+{
+    assert(table != NULL);
+
+    table->max_entries    = max_entries;
+    table->max_bytes      = max_bytes;
+    table->evict          = evict;
+    table->evict_argument = argument;
+
+    while (table->length != 0 && hashTableOverLimit(table, 0))
+    {
+        hashTableEvictOne(table);
+    }
+
+    return HASH_TABLE_SUCCESS;
+}
+
+
+HashTableOperationError hashTableSetKeyBase(HashTable* table, const char* key_base)
+{
+    assert(table    != NULL);
+    assert(key_base != NULL);
+
+    if (table->entries_used != 0)
+    {
+        fprintf(stderr, "Key base can only be set on an empty table\n");
+        return HASH_TABLE_ERROR;
+    }
+
+    table->key_base = key_base;
+
+    return HASH_TABLE_SUCCESS;
+}
+
+
+HashTableOperationError hashTableSetTokenKeys(HashTable* table)
+{
+    assert(table != NULL);
+
+    if (table->entries_used != 0)
+    {
+        fprintf(stderr, "Token keys can only be set on an empty table\n");
+        return HASH_TABLE_ERROR;
+    }
+
+    table->token_keys = true;
+
+    return HASH_TABLE_SUCCESS;
+}
+
+
+bool hashTableHasTokenKeys(HashTable* table)
+{
+    assert(table != NULL);
+
+    return table->token_keys;
+}
+
+
+size_t hashTabelLength(HashTable* table)
+{
+    assert(table != NULL);
+
+    return table->length;
+}
+
+
+HashTableReader* hashTableReaderRegister(HashTable* table)
+{
+    assert(table != NULL);
+
+    HashTableReader* reader = __atomic_load_n(&table->readers, __ATOMIC_ACQUIRE);
+    for (; reader; reader = reader->next)
     {
-        Node* node = &node_array[current_index];
-        NodeData* node_data = &list->data[current_index];
-        if (!memcmp(node_data->key_pointer, key, length))
+        bool expected = false;
+        if (__atomic_compare_exchange_n(&reader->in_use, &expected, true, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
         {
-            return node_data->count;
+            return reader;
         }
-        current_index = node->next;
     }
 
-    return 0;
+    reader = (HashTableReader*)aligned_alloc(CACHE_LINE_SIZE, sizeof(HashTableReader));
+    if (!reader)
+    {
+        fprintf(stderr, "Error while allocating hash table reader\n");
+        return NULL;
+    }
+    memset(reader, 0, sizeof(HashTableReader));
+
+    reader->table  = table;
+    reader->epoch  = QUIESCENT_EPOCH;
+    reader->in_use = true;
+
+    reader->next = __atomic_load_n(&table->readers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&table->readers, &reader->next, reader, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+    }
+
+    return reader;
+}
+
+
+void hashTableReaderUnregister(HashTableReader* reader)
+{
+    assert(reader != NULL);
+
+    __atomic_store_n(&reader->epoch,  QUIESCENT_EPOCH, __ATOMIC_RELEASE);
+    __atomic_store_n(&reader->in_use, false,           __ATOMIC_RELEASE);
+}
+
+
+size_t hashTableReaderGet(HashTableReader* reader, const char* key, size_t length)
+{
+    assert(reader != NULL);
+    assert(key    != NULL);
+
+    HashTable* table = reader->table;
+
+    uint64_t hash = hashTableHash(table, key, length);
+
+    // announce the epoch before looking at the storage so the writer can not
+    // free it behind our back
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&table->epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+
+    Storage* storage = __atomic_load_n(&table->storage, __ATOMIC_SEQ_CST);
+
+    size_t count = 0;
+
+    int entry_index = __atomic_load_n(&storage->buckets[hash & (storage->capacity - 1)],
+                                      __ATOMIC_ACQUIRE);
+    while (entry_index != NO_ENTRY)
+    {
+        Entry* entry = &storage->entries[entry_index];
+        if (entryMatches(table, entry, key, length, hash))
+        {
+            count = __atomic_load_n(&entry->count, __ATOMIC_RELAXED);
+            break;
+        }
+        entry_index = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+    }
+
+    __atomic_store_n(&reader->epoch, QUIESCENT_EPOCH, __ATOMIC_RELEASE);
+
+    return count;
 }
 
 
 HashTableIterator hashTableIterator(HashTable* table)
+{
+    return hashTableIteratorSlice(table, 0, 1);
+}
+
+
+HashTableIterator hashTableIteratorSlice(HashTable* table, size_t slice, size_t slice_count)
 {
     assert(table != NULL);
-    
+    assert(slice < slice_count);
+
     return {
         .key    = NULL,
         .length = 0,
         .count  = 0,
+        .value  = NULL,
 
-        ._table = table,
-        ._bucket_index = 0,
-        ._node_index = 0,
+        ._table       = table,
+        ._entry_index = table->entries_used * slice       / slice_count,
+        ._entry_end   = table->entries_used * (slice + 1) / slice_count,
     };
 }
 
@@ -221,123 +614,536 @@ bool hashTableNext(HashTableIterator* iterator)
     assert(iterator         != NULL);
     assert(iterator->_table != NULL);
 
-    while (iterator->_bucket_index < iterator->_table->capacity)
+    HashTable* table = iterator->_table;
+
+    while (iterator->_entry_index < iterator->_entry_end)
     {
-        List* list = &iterator->_table->buckets[iterator->_bucket_index];
-        Node* node_array = list->node_array;
+        Entry* entry = &table->storage->entries[iterator->_entry_index++];
+        if (isEntryDeleted(entry))
+        {
+            continue;
+        }
 
-        iterator->_node_index = node_array[iterator->_node_index].next;
+        iterator->key    = entryKey(table, entry);
+        iterator->length = entry->length;
+        iterator->count  = entry->count;
+        iterator->value  = hashTableEntryValue(table, entry);
 
-        if (iterator->_node_index != 0)
-        {
-            NodeData* node = &list->data[iterator->_node_index];
+        return true;
+    }
+
+    return false;
+}
+
+
+// static ----------------------------------------------------------------------
 
-            iterator->key    = node->key_pointer;
-            iterator->length = node->length;
-            iterator->count  = node->count;
 
-            return true;
+static Entry* hashTableSetHashed(HashTable* table, const char* key, size_t length,
+                                 uint64_t hash, bool* inserted)
+{
+    assert(table    != NULL);
+    assert(key      != NULL);
+    assert(inserted != NULL);
+
+    Entry* entry = hashTableFind(table, key, length, hash);
+    if (entry)
+    {
+        __atomic_store_n(&entry->count, entry->count + 1, __ATOMIC_RELAXED);
+
+        *inserted = false;
+        return entry;
+    }
+
+    size_t new_bytes = entryBytes(table, length);
+    while (table->length != 0 && hashTableOverLimit(table, new_bytes))
+    {
+        hashTableEvictOne(table);
+    }
+
+    if (table->entries_used == table->storage->entries_capacity)
+    {
+        // mostly deleted entries are only compacted, otherwise grow
+        size_t new_capacity = table->storage->capacity;
+        if (table->length >= table->entries_used / 2)
+        {
+            new_capacity *= SCALE_FACTOR;
         }
-        else
+
+        if (hashTableRebuild(table, new_capacity) != HASH_TABLE_SUCCESS)
         {
-            iterator->_bucket_index++; 
-            iterator->_node_index = 0;
+            fprintf(stderr, "Error while resizing hash table\n");
+            return NULL;
         }
     }
 
-    return false;
+    Storage* storage = table->storage;
+
+    size_t bucket_index = hash & (storage->capacity - 1);
+    int    entry_index  = (int)table->entries_used++;
+
+    Entry* new_entry = &storage->entries[entry_index];
+    if (!entryInit(table, new_entry, key, length, hash))
+    {
+        table->entries_used--;
+        return NULL;
+    }
+
+    new_entry->count = 1;
+    new_entry->next  = storage->buckets[bucket_index];
+
+    memset(storage->values + entry_index * table->value_stride, 0, table->value_stride);
+
+    __atomic_store_n(&storage->buckets[bucket_index], entry_index, __ATOMIC_RELEASE);
+
+    table->length++;
+    table->bytes += new_bytes;
+
+    *inserted = true;
+    return new_entry;
 }
 
 
-// static ----------------------------------------------------------------------
+static void* hashTableEntryValue(HashTable* table, Entry* entry)
+{
+    assert(table != NULL);
+    assert(entry != NULL);
+
+    Storage* storage = table->storage;
+
+    return storage->values + (entry - storage->entries) * table->value_stride;
+}
+
+
+static size_t entryBytes(const HashTable* table, size_t length)
+{
+    return sizeof(Entry) + table->value_stride + length;
+}
 
 
-static HashTableOperationError hashTableResize(HashTable* table)
+static void hashTableRemoveEntry(HashTable* table, int* link, Entry* entry)
 {
     assert(table != NULL);
+    assert(link  != NULL);
+    assert(entry != NULL);
+
+    // the entry keeps its next link, readers standing on it can still walk
+    // the rest of the chain
+    __atomic_store_n(link, entry->next, __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->count, 0, __ATOMIC_RELAXED);
+
+    table->length--;
+    table->bytes -= entryBytes(table, entry->length);
+}
+
+
+static bool hashTableOverLimit(const HashTable* table, size_t new_bytes)
+{
+    assert(table != NULL);
+
+    return (table->max_entries && table->length + (new_bytes != 0) > table->max_entries)
+        || (table->max_bytes   && table->bytes  + new_bytes         > table->max_bytes);
+}
+
+
+static void hashTableEvictOne(HashTable* table)
+{
+    assert(table != NULL);
+    assert(table->length != 0);
+
+    Storage* storage = table->storage;
+
+    // CLOCK over the dense entries: the hand halves the count of every key it
+    // passes and evicts the first one that was not used since its last visit
+    for (;;)
+    {
+        if (table->clock_hand >= table->entries_used)
+        {
+            table->clock_hand = 0;
+        }
+
+        Entry* entry = &storage->entries[table->clock_hand++];
+        if (isEntryDeleted(entry))
+        {
+            continue;
+        }
+
+        if (entry->count > 1)
+        {
+            __atomic_store_n(&entry->count, entry->count / 2, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        int  entry_index = (int)(entry - storage->entries);
+        int* link = &storage->buckets[entryHash(table, entry) & (storage->capacity - 1)];
+        while (*link != entry_index)
+        {
+            link = &storage->entries[*link].next;
+        }
+
+        size_t count = entry->count;
+        hashTableRemoveEntry(table, link, entry);
+
+        if (table->evict)
+        {
+            hashTableReleaseKey(table, entryKey(table, entry), entry->length, count);
+        }
+
+        return;
+    }
+}
 
-    size_t old_capacity = table->capacity;
-    table->capacity *= SCALE_FACTOR;
 
-    List* new_buckets = (List*)calloc(table->capacity, sizeof(List));
-    if (!new_buckets)
+static void hashTableReleaseKey(HashTable* table, const char* key, size_t length, size_t count)
+{
+    assert(table != NULL);
+
+    if (!__atomic_load_n(&table->readers, __ATOMIC_ACQUIRE))
     {
-        return HASH_TABLE_BAD_MEMORY_ALLOCATION; 
+        table->evict(key, length, count, table->evict_argument);
+        return;
     }
 
-    for (size_t index = 0; index < table->capacity; index++) 
+    // readers may still be comparing the key, hand it back after they leave
+    if (table->evicted_count == table->evicted_capacity)
     {
-        if (listCtor(&new_buckets[index], LIST_INITIAL_CAPACITY) != ListOperationError_SUCCESS)
-        {
-            for (size_t i = 0; i < index; i++)
-            {
-                listDtor(&new_buckets[i]);
-            }
+        size_t new_capacity = table->evicted_capacity ? table->evicted_capacity * SCALE_FACTOR
+                                                      : INITIAL_CAPACITY;
 
-            free(new_buckets);
-            return HASH_TABLE_BAD_MEMORY_ALLOCATION;
+        EvictedKey* new_evicted = (EvictedKey*)realloc(table->evicted,
+                                                       new_capacity * sizeof(EvictedKey));
+        if (!new_evicted)
+        {
+            fprintf(stderr, "Error while deferring evicted key, keeping it\n");
+            return;
         }
+
+        table->evicted          = new_evicted;
+        table->evicted_capacity = new_capacity;
     }
-    
-    for (size_t index = 0; index < old_capacity; index++)
+
+    table->evicted[table->evicted_count++] = {
+        .key    = key,
+        .length = length,
+        .count  = count,
+        .epoch  = __atomic_fetch_add(&table->epoch, 1, __ATOMIC_SEQ_CST),
+
+        .evict          = table->evict,
+        .evict_argument = table->evict_argument,
+    };
+
+    hashTableReclaim(table);
+}
+
+
+static size_t capacityForLength(size_t length)
+{
+    size_t capacity = INITIAL_CAPACITY;
+    while ((double)length / capacity > LOAD_FACTOR)
     {
-        List* list = &table->buckets[index];
-        Node* node_array = list->node_array;
+        capacity *= SCALE_FACTOR;
+    }
+
+    return capacity;
+}
 
-        size_t current_index = node_array[0].next;
-        while (current_index != 0)
+
+static uint64_t hashTableHash(const HashTable* table, const char* key, size_t length)
+{
+    return table->token_keys ? hashStringTokens(key, length) : hashString(key, length);
+}
+
+
+// token keys match when their words match, whatever whitespace is between
+static bool keysEqual(const HashTable* table, const char* first, size_t first_length,
+                      const char* second, size_t second_length)
+{
+    if (first_length == second_length && !memcmp(first, second, first_length))
+    {
+        return true;
+    }
+    if (!table->token_keys)
+    {
+        return false;
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < first_length && j < second_length)
+    {
+        bool first_space  = isspace((unsigned char)first[i]);
+        bool second_space = isspace((unsigned char)second[j]);
+        if (first_space != second_space)
         {
-            Node* node = &node_array[current_index];
-            NodeData* node_data = &list->data[current_index];
-
-            size_t new_index = hashFunction(node_data->key_pointer, node_data->length, table->capacity);
-            List* new_list = &new_buckets[new_index];
-            
-            int list_index = listInsertTail(new_list);
-            if (list_index == 0)
-            {
-                fprintf(stderr, "Erro accured in resizing hash table");
+            return false;
+        }
 
-                for (size_t i = 0; i < index; i++) 
-                {
-                    listDtor(&new_buckets[i]);
-                }
+        if (first_space)
+        {
+            while (i < first_length  && isspace((unsigned char)first[i]))  i++;
+            while (j < second_length && isspace((unsigned char)second[j])) j++;
+            continue;
+        }
 
-                free(new_buckets);
-                return HASH_TABLE_BAD_MEMORY_ALLOCATION;
-            }
+        if (first[i++] != second[j++])
+        {
+            return false;
+        }
+    }
 
-            NodeData* new_node_data = &new_list->data[list_index];
+    return i == first_length && j == second_length;
+}
+
+
+static bool isEntryDeleted(const Entry* entry)
+{
+    assert(entry != NULL);
+
+    return entry->count == 0;
+}
+
+
+#ifdef HASH_TABLE_COMPACT_ENTRIES
+
+static const char* entryKey(const HashTable* table, const Entry* entry)
+{
+    return table->key_base + entry->key_offset;
+}
+
+
+static uint32_t entryHash(const HashTable* table, const Entry* entry)
+{
+    return (uint32_t)hashTableHash(table, entryKey(table, entry), entry->length);
+}
+
+
+static bool entryMatches(const HashTable* table, const Entry* entry,
+                         const char* key, size_t length, uint64_t hash)
+{
+    return entry->hash_tag == (uint16_t)(hash >> 16)
+        && keysEqual(table, entryKey(table, entry), entry->length, key, length);
+}
+
+
+static bool entryInit(const HashTable* table, Entry* entry,
+                      const char* key, size_t length, uint64_t hash)
+{
+    if (key < table->key_base
+     || (size_t)(key - table->key_base) > MAX_KEY_OFFSET
+     || length > MAX_KEY_LENGTH)
+    {
+        fprintf(stderr, "Key does not fit into a compact entry\n");
+        return false;
+    }
 
-            new_node_data->key_pointer = node_data->key_pointer;
-            new_node_data->length      = node_data->length;
-            new_node_data->count       = node_data->count;
+    entry->key_offset = (uint32_t)(key - table->key_base);
+    entry->length     = (uint16_t)length;
+    entry->hash_tag   = (uint16_t)(hash >> 16);
 
-            current_index = node->next;
+    return true;
+}
+
+#else
+
+static const char* entryKey(const HashTable* table, const Entry* entry)
+{
+    (void)table;
+    return entry->key_pointer;
+}
+
+
+static uint32_t entryHash(const HashTable* table, const Entry* entry)
+{
+    (void)table;
+    return entry->hash;
+}
+
+
+static bool entryMatches(const HashTable* table, const Entry* entry,
+                         const char* key, size_t length, uint64_t hash)
+{
+    return entry->hash == (uint32_t)hash
+        && keysEqual(table, entry->key_pointer, entry->length, key, length);
+}
+
+
+static bool entryInit(const HashTable* table, Entry* entry,
+                      const char* key, size_t length, uint64_t hash)
+{
+    (void)table;
+
+    entry->key_pointer = key;
+    entry->length      = length;
+    entry->hash        = (uint32_t)hash;
+
+    return true;
+}
+
+#endif
+
+
+static Entry* hashTableFind(HashTable* table, const char* key, size_t length, uint64_t hash)
+{
+    assert(table != NULL);
+    assert(key   != NULL);
+
+    Storage* storage = table->storage;
+
+    int entry_index = storage->buckets[hash & (storage->capacity - 1)];
+    while (entry_index != NO_ENTRY)
+    {
+        Entry* entry = &storage->entries[entry_index];
+        if (entryMatches(table, entry, key, length, hash))
+        {
+            return entry;
         }
+        entry_index = entry->next;
+    }
+
+    return NULL;
+}
+
+
+static Storage* storageCtor(size_t capacity, size_t value_stride)
+{
+    size_t entries_capacity = capacity * LOAD_FACTOR;
+
+    // capacity is a power of two, so the entries that follow the buckets
+    // stay aligned
+    Storage* storage = (Storage*)malloc(sizeof(Storage)
+                                      + capacity * sizeof(int)
+                                      + entries_capacity * sizeof(Entry)
+                                      + entries_capacity * value_stride);
+    if (!storage)
+    {
+        return NULL;
+    }
+
+    storage->capacity         = capacity;
+    storage->entries_capacity = entries_capacity;
+    storage->buckets          = (int*)(storage + 1);
+    storage->entries          = (Entry*)(storage->buckets + capacity);
+    storage->values           = (char*)(storage->entries + entries_capacity);
+    storage->retired_next     = NULL;
+    storage->retired_epoch    = QUIESCENT_EPOCH;
+
+    memset(storage->buckets, 0xFF, capacity * sizeof(int));
+
+    return storage;
+}
+
+
+static HashTableOperationError hashTableRebuild(HashTable* table, size_t new_capacity)
+{
+    assert(table != NULL);
+
+    size_t value_stride = table->value_stride;
+
+    Storage* new_storage = storageCtor(new_capacity, value_stride);
+    if (!new_storage)
+    {
+        return HASH_TABLE_BAD_MEMORY_ALLOCATION;
     }
 
-    for (size_t index = 0; index < old_capacity; index++)
+    Storage* old_storage = table->storage;
+
+    size_t live = 0;
+    size_t mask = new_capacity - 1;
+    size_t clock_hand = 0;
+    for (size_t index = 0; index < table->entries_used; index++)
     {
-        listDtor(&table->buckets[index]);
+        if (index == table->clock_hand)
+        {
+            clock_hand = live;
+        }
+
+        Entry* entry = &old_storage->entries[index];
+        if (isEntryDeleted(entry))
+        {
+            continue;
+        }
+
+        Entry* new_entry = &new_storage->entries[live];
+        *new_entry = *entry;
+
+        memcpy(new_storage->values + live  * value_stride,
+               old_storage->values + index * value_stride,
+               value_stride);
+
+        size_t bucket_index = entryHash(table, entry) & mask;
+
+        new_entry->next = new_storage->buckets[bucket_index];
+        new_storage->buckets[bucket_index] = (int)live++;
     }
 
-    free(table->buckets);
-    table->buckets = new_buckets;
-    
+    table->entries_used = live;
+    table->clock_hand   = clock_hand;
+
+    __atomic_store_n(&table->storage, new_storage, __ATOMIC_SEQ_CST);
+    hashTableRetire(table, old_storage);
+
     return HASH_TABLE_SUCCESS;
 }
 
 
-static size_t hashFunction(const char* data, size_t length, size_t capacity)
+static void hashTableRetire(HashTable* table, Storage* storage)
+{
+    assert(table   != NULL);
+    assert(storage != NULL);
+
+    // readers that announce a later epoch have already seen the new storage
+    storage->retired_epoch = __atomic_fetch_add(&table->epoch, 1, __ATOMIC_SEQ_CST);
+    storage->retired_next  = table->retired;
+    table->retired = storage;
+
+    hashTableReclaim(table);
+}
+
+
+static void hashTableReclaim(HashTable* table)
 {
-    assert(data != NULL);
+    assert(table != NULL);
 
-    unsigned long hash = 5381;
-    for (size_t i = 0; i < length; i++)
+    uint64_t oldest_epoch = UINT64_MAX;
+
+    HashTableReader* reader = __atomic_load_n(&table->readers, __ATOMIC_ACQUIRE);
+    for (; reader; reader = reader->next)
     {
-        hash = ((hash << 5) + hash) + (unsigned char)data[i];
+        uint64_t epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+        if (epoch != QUIESCENT_EPOCH && epoch < oldest_epoch)
+        {
+            oldest_epoch = epoch;
+        }
     }
 
-    return (size_t)hash % capacity;
+    size_t pending = 0;
+    for (size_t i = 0; i < table->evicted_count; i++)
+    {
+        EvictedKey* evicted = &table->evicted[i];
+        if (evicted->epoch < oldest_epoch)
+        {
+            evicted->evict(evicted->key, evicted->length, evicted->count,
+                           evicted->evict_argument);
+        }
+        else
+        {
+            table->evicted[pending++] = *evicted;
+        }
+    }
+    table->evicted_count = pending;
+
+    Storage** link = &table->retired;
+    while (*link)
+    {
+        Storage* storage = *link;
+        if (storage->retired_epoch < oldest_epoch)
+        {
+            *link = storage->retired_next;
+            free(storage);
+        }
+        else
+        {
+            link = &storage->retired_next;
+        }
+    }
 }
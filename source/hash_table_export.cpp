@@ -0,0 +1,710 @@
+#include "hash_table_export.h"
+
+#include <ctype.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+
+// static ----------------------------------------------------------------------
+
+
+#define MAX_THREADS          64
+#define MIN_GATHER_SLICE     (1 << 14)
+#define RADIX                257 // digit 0 means the key already ended
+#define COUNT_DIGITS         sizeof(size_t)
+#define INSERTION_SORT_LIMIT 32
+#define PARALLEL_SORT_LIMIT  (1 << 14)
+#define WRITE_BUFFER_SIZE    (1 << 20)
+#define MAX_COUNT_DIGITS     20
+
+typedef struct GatherSlice
+{
+    HashTable*            table;
+    size_t                slice;
+    size_t                slice_count;
+    size_t                length;
+    size_t                key_bytes;
+    HashTableExportEntry* out;
+
+    // token tables only: out gets folded copies of the keys written to
+    // folded_keys, each pointing through value at its raw entry in raw
+    HashTableExportEntry* raw;
+    char*                 folded_keys;
+} GatherSlice;
+
+typedef struct SortTask
+{
+    size_t begin;
+    size_t end;
+    size_t depth;
+} SortTask;
+
+// shared stack of ranges still to sort; pending counts pushed tasks that
+// have not finished, the sort is over when it drops to zero
+typedef struct SortPool
+{
+    HashTableExportEntry* entries;
+    HashTableExportEntry* buffer;
+    HashTableOrder        order;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+    SortTask*       tasks;
+    size_t          task_count;
+    size_t          task_capacity;
+    size_t          pending;
+} SortPool;
+
+static size_t exportThreadCount(size_t length);
+static void* gatherCount(void* argument);
+static void* gatherFill(void* argument);
+static void runThreads(void* (*routine)(void*), GatherSlice* slices, size_t thread_count);
+static size_t foldTokens(char* destination, const char* key, size_t length);
+static bool writeTokens(FILE* file, const char* key, size_t length);
+
+static int entryDigit(const HashTableExportEntry* entry, size_t depth, HashTableOrder order);
+static int compareEntries(const HashTableExportEntry* first, const HashTableExportEntry* second,
+                          HashTableOrder order);
+static void insertionSort(HashTableExportEntry* entries, size_t length, HashTableOrder order);
+static void radixSort(SortPool* pool, size_t begin, size_t end, size_t depth);
+static bool sortPoolPush(SortPool* pool, size_t begin, size_t end, size_t depth);
+static void* sortWorker(void* argument);
+
+static char* writeCount(char* destination, size_t count);
+
+
+// public ----------------------------------------------------------------------
+
+
+HashTableOperationError hashTableExportSorted(HashTable* table, HashTableOrder order,
+                                              HashTableExportEntry* out)
+{
+    assert(table != NULL);
+
+    size_t length = hashTabelLength(table);
+    if (length == 0)
+    {
+        return HASH_TABLE_SUCCESS;
+    }
+    if (!out || (order != HASH_TABLE_ORDER_KEY && order != HASH_TABLE_ORDER_COUNT))
+    {
+        return HASH_TABLE_INVALID_INPUT;
+    }
+
+    size_t thread_count = exportThreadCount(length);
+
+    // every thread counts the live keys of its slice, then copies them
+    // right after the keys of the slices before it
+    GatherSlice slices[MAX_THREADS] = {};
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        slices[i] = {
+            .table       = table,
+            .slice       = i,
+            .slice_count = thread_count,
+            .length      = 0,
+            .key_bytes   = 0,
+            .out         = NULL,
+            .raw         = NULL,
+            .folded_keys = NULL,
+        };
+    }
+
+    runThreads(gatherCount, slices, thread_count);
+
+    // token keys are sorted as their words joined by single spaces, so the
+    // sort runs on folded copies and the raw entries are put back after it
+    bool token_keys = hashTableHasTokenKeys(table);
+
+    size_t key_bytes = 0;
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        key_bytes += slices[i].key_bytes;
+    }
+
+    HashTableExportEntry* raw = NULL;
+    char* folded_keys = NULL;
+    if (token_keys)
+    {
+        raw         = (HashTableExportEntry*)calloc(length, sizeof(HashTableExportEntry));
+        folded_keys = (char*)malloc(key_bytes + 1);
+        if (!raw || !folded_keys)
+        {
+            fprintf(stderr, "Could not allocate export buffer\n");
+            free(raw);
+            free(folded_keys);
+            return HASH_TABLE_BAD_MEMORY_ALLOCATION;
+        }
+    }
+
+    size_t offset = 0;
+    size_t key_offset = 0;
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        slices[i].out = out + offset;
+        if (token_keys)
+        {
+            slices[i].raw         = raw + offset;
+            slices[i].folded_keys = folded_keys + key_offset;
+        }
+        offset     += slices[i].length;
+        key_offset += slices[i].key_bytes;
+    }
+    assert(offset == length);
+
+    runThreads(gatherFill, slices, thread_count);
+
+    HashTableExportEntry* buffer = (HashTableExportEntry*)calloc(length, sizeof(HashTableExportEntry));
+    if (!buffer)
+    {
+        fprintf(stderr, "Could not allocate export buffer\n");
+        free(raw);
+        free(folded_keys);
+        return HASH_TABLE_BAD_MEMORY_ALLOCATION;
+    }
+
+    SortPool pool = {
+        .entries = out,
+        .buffer  = buffer,
+        .order   = order,
+
+        .lock          = PTHREAD_MUTEX_INITIALIZER,
+        .ready         = PTHREAD_COND_INITIALIZER,
+        .tasks         = NULL,
+        .task_count    = 0,
+        .task_capacity = 0,
+        .pending       = 0,
+    };
+
+    if (!sortPoolPush(&pool, 0, length, 0))
+    {
+        radixSort(&pool, 0, length, 0);
+    }
+
+    // the calling thread sorts too, so a single core spawns nothing
+    pthread_t workers[MAX_THREADS] = {};
+    size_t worker_count = 0;
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        if (pthread_create(&workers[worker_count], NULL, sortWorker, &pool) != 0)
+        {
+            break;
+        }
+        worker_count++;
+    }
+
+    sortWorker(&pool);
+    for (size_t i = 0; i < worker_count; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.ready);
+    free(pool.tasks);
+    free(buffer);
+
+    if (token_keys)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            out[i] = *(const HashTableExportEntry*)out[i].value;
+        }
+    }
+    free(raw);
+    free(folded_keys);
+
+    return HASH_TABLE_SUCCESS;
+}
+
+
+HashTableOperationError hashTableExportSortedToFile(HashTable* table, HashTableOrder order,
+                                                    FILE* file)
+{
+    assert(table != NULL);
+
+    if (!file)
+    {
+        return HASH_TABLE_INVALID_INPUT;
+    }
+
+    size_t length = hashTabelLength(table);
+    HashTableExportEntry* entries = (HashTableExportEntry*)calloc(length + 1, sizeof(HashTableExportEntry));
+    char* buffer = (char*)malloc(WRITE_BUFFER_SIZE);
+    if (!entries || !buffer)
+    {
+        fprintf(stderr, "Could not allocate export buffer\n");
+        free(entries);
+        free(buffer);
+        return HASH_TABLE_BAD_MEMORY_ALLOCATION;
+    }
+
+    HashTableOperationError error = hashTableExportSorted(table, order, entries);
+    bool token_keys = hashTableHasTokenKeys(table);
+
+    char* position = buffer;
+    for (size_t i = 0; error == HASH_TABLE_SUCCESS && i < length; i++)
+    {
+        const HashTableExportEntry* entry = &entries[i];
+        size_t line_length = entry->length + MAX_COUNT_DIGITS + 2;
+
+        if ((size_t)(buffer + WRITE_BUFFER_SIZE - position) < line_length)
+        {
+            if (fwrite(buffer, 1, position - buffer, file) != (size_t)(position - buffer))
+            {
+                error = HASH_TABLE_ERROR;
+            }
+            position = buffer;
+        }
+
+        // token keys may hold newlines between their words, they are written
+        // with one space instead so every line stays "key count"
+        if (line_length > WRITE_BUFFER_SIZE)
+        {
+            // a key longer than the whole buffer goes out on its own
+            bool written = token_keys ? writeTokens(file, entry->key, entry->length)
+                                      : fwrite(entry->key, 1, entry->length, file) == entry->length;
+            if (!written)
+            {
+                error = HASH_TABLE_ERROR;
+            }
+        }
+        else if (token_keys)
+        {
+            position += foldTokens(position, entry->key, entry->length);
+        }
+        else
+        {
+            memcpy(position, entry->key, entry->length);
+            position += entry->length;
+        }
+
+        *position++ = ' ';
+        position    = writeCount(position, entry->count);
+        *position++ = '\n';
+    }
+
+    if (error == HASH_TABLE_SUCCESS &&
+        fwrite(buffer, 1, position - buffer, file) != (size_t)(position - buffer))
+    {
+        error = HASH_TABLE_ERROR;
+    }
+
+    if (error == HASH_TABLE_ERROR)
+    {
+        fprintf(stderr, "Could not write sorted table\n");
+    }
+
+    free(entries);
+    free(buffer);
+
+    return error;
+}
+
+
+// static ----------------------------------------------------------------------
+
+
+static size_t exportThreadCount(size_t length)
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = online > 0 ? (size_t)online : 1;
+
+    if (thread_count > MAX_THREADS)
+    {
+        thread_count = MAX_THREADS;
+    }
+    if (thread_count > length / MIN_GATHER_SLICE)
+    {
+        thread_count = length / MIN_GATHER_SLICE;
+    }
+
+    return thread_count ? thread_count : 1;
+}
+
+
+static void* gatherCount(void* argument)
+{
+    GatherSlice* slice = (GatherSlice*)argument;
+    HashTableIterator iterator = hashTableIteratorSlice(slice->table, slice->slice, slice->slice_count);
+
+    while (hashTableNext(&iterator))
+    {
+        slice->length++;
+        slice->key_bytes += iterator.length;
+    }
+
+    return NULL;
+}
+
+
+static void* gatherFill(void* argument)
+{
+    GatherSlice* slice = (GatherSlice*)argument;
+    HashTableIterator iterator = hashTableIteratorSlice(slice->table, slice->slice, slice->slice_count);
+
+    HashTableExportEntry* out = slice->out;
+    HashTableExportEntry* raw = slice->raw;
+    char* folded_key = slice->folded_keys;
+    while (hashTableNext(&iterator))
+    {
+        HashTableExportEntry entry = {
+            .key    = iterator.key,
+            .length = iterator.length,
+            .count  = iterator.count,
+            .value  = iterator.value,
+        };
+
+        if (!raw)
+        {
+            *out++ = entry;
+            continue;
+        }
+
+        size_t folded_length = foldTokens(folded_key, entry.key, entry.length);
+
+        *raw = entry;
+        *out++ = {
+            .key    = folded_key,
+            .length = folded_length,
+            .count  = entry.count,
+            .value  = raw++,
+        };
+        folded_key += folded_length;
+    }
+
+    return NULL;
+}
+
+
+static void runThreads(void* (*routine)(void*), GatherSlice* slices, size_t thread_count)
+{
+    assert(routine != NULL);
+    assert(slices  != NULL);
+
+    pthread_t threads[MAX_THREADS] = {};
+    bool started[MAX_THREADS] = {};
+
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        started[i] = pthread_create(&threads[i], NULL, routine, &slices[i]) == 0;
+    }
+
+    // a slice whose thread could not start is done here instead
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        if (!started[i])
+        {
+            routine(&slices[i]);
+        }
+    }
+
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+
+// copies the key with every whitespace run replaced by one space, the way
+// token tables hash and compare it
+static size_t foldTokens(char* destination, const char* key, size_t length)
+{
+    assert(destination != NULL);
+    assert(key         != NULL);
+
+    size_t folded_length = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (!isspace((unsigned char)key[i]))
+        {
+            destination[folded_length++] = key[i];
+            continue;
+        }
+
+        while (i + 1 < length && isspace((unsigned char)key[i + 1]))
+        {
+            i++;
+        }
+        destination[folded_length++] = ' ';
+    }
+
+    return folded_length;
+}
+
+
+static bool writeTokens(FILE* file, const char* key, size_t length)
+{
+    assert(file != NULL);
+    assert(key  != NULL);
+
+    size_t word_begin = 0;
+    for (size_t i = 0; i <= length; i++)
+    {
+        if (i < length && !isspace((unsigned char)key[i]))
+        {
+            continue;
+        }
+
+        if (fwrite(key + word_begin, 1, i - word_begin, file) != i - word_begin)
+        {
+            return false;
+        }
+        if (i == length)
+        {
+            break;
+        }
+
+        while (i + 1 < length && isspace((unsigned char)key[i + 1]))
+        {
+            i++;
+        }
+        if (fputc(' ', file) == EOF)
+        {
+            return false;
+        }
+        word_begin = i + 1;
+    }
+
+    return true;
+}
+
+
+static int entryDigit(const HashTableExportEntry* entry, size_t depth, HashTableOrder order)
+{
+    assert(entry != NULL);
+
+    // counts go first as big-endian bytes of their complement, so larger
+    // counts sort earlier, then the key breaks ties
+    if (order == HASH_TABLE_ORDER_COUNT)
+    {
+        if (depth < COUNT_DIGITS)
+        {
+            size_t shift = 8 * (COUNT_DIGITS - 1 - depth);
+            return (int)((~entry->count >> shift) & 0xFF) + 1;
+        }
+        depth -= COUNT_DIGITS;
+    }
+
+    return depth < entry->length ? (unsigned char)entry->key[depth] + 1 : 0;
+}
+
+
+static int compareEntries(const HashTableExportEntry* first, const HashTableExportEntry* second,
+                          HashTableOrder order)
+{
+    assert(first  != NULL);
+    assert(second != NULL);
+
+    if (order == HASH_TABLE_ORDER_COUNT && first->count != second->count)
+    {
+        return first->count > second->count ? -1 : 1;
+    }
+
+    size_t length = first->length < second->length ? first->length : second->length;
+    int difference = memcmp(first->key, second->key, length);
+    if (difference)
+    {
+        return difference;
+    }
+
+    return (first->length > second->length) - (first->length < second->length);
+}
+
+
+static void insertionSort(HashTableExportEntry* entries, size_t length, HashTableOrder order)
+{
+    assert(entries != NULL);
+
+    for (size_t i = 1; i < length; i++)
+    {
+        HashTableExportEntry entry = entries[i];
+
+        size_t j = i;
+        while (j > 0 && compareEntries(&entry, &entries[j - 1], order) < 0)
+        {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = entry;
+    }
+}
+
+
+static void radixSort(SortPool* pool, size_t begin, size_t end, size_t depth)
+{
+    assert(pool != NULL);
+
+    HashTableExportEntry* entries = pool->entries;
+    HashTableExportEntry* buffer  = pool->buffer;
+
+    // the largest part is sorted by this loop rather than recursion, so the
+    // stack only grows for parts at most half the size
+    while (end - begin > INSERTION_SORT_LIMIT)
+    {
+        size_t counts[RADIX] = {};
+
+        // a digit every entry shares splits nothing, step over it in place
+        for (;;)
+        {
+            memset(counts, 0, sizeof(counts));
+            for (size_t i = begin; i < end; i++)
+            {
+                counts[entryDigit(&entries[i], depth, pool->order)]++;
+            }
+
+            if (counts[0] == end - begin)
+            {
+                return;
+            }
+
+            int digit = entryDigit(&entries[begin], depth, pool->order);
+            if (counts[digit] != end - begin)
+            {
+                break;
+            }
+            depth++;
+        }
+
+        size_t starts[RADIX] = {};
+        size_t offset = begin;
+        for (int digit = 0; digit < RADIX; digit++)
+        {
+            starts[digit] = offset;
+            offset       += counts[digit];
+        }
+
+        size_t positions[RADIX] = {};
+        memcpy(positions, starts, sizeof(positions));
+        for (size_t i = begin; i < end; i++)
+        {
+            buffer[positions[entryDigit(&entries[i], depth, pool->order)]++] = entries[i];
+        }
+        memcpy(entries + begin, buffer + begin, (end - begin) * sizeof(HashTableExportEntry));
+
+        int largest = 1;
+        for (int digit = 2; digit < RADIX; digit++)
+        {
+            if (counts[digit] > counts[largest])
+            {
+                largest = digit;
+            }
+        }
+
+        // keys that ended here are all equal, the rest go one digit deeper
+        for (int digit = 1; digit < RADIX; digit++)
+        {
+            size_t part_begin = starts[digit];
+            size_t part_end   = part_begin + counts[digit];
+            if (digit == largest || part_end - part_begin < 2)
+            {
+                continue;
+            }
+
+            if (part_end - part_begin < PARALLEL_SORT_LIMIT ||
+                !sortPoolPush(pool, part_begin, part_end, depth + 1))
+            {
+                radixSort(pool, part_begin, part_end, depth + 1);
+            }
+        }
+
+        begin  = starts[largest];
+        end    = begin + counts[largest];
+        depth += 1;
+    }
+
+    insertionSort(entries + begin, end - begin, pool->order);
+}
+
+
+static bool sortPoolPush(SortPool* pool, size_t begin, size_t end, size_t depth)
+{
+    assert(pool != NULL);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->task_count == pool->task_capacity)
+    {
+        size_t capacity = pool->task_capacity ? pool->task_capacity * 2 : RADIX;
+        SortTask* tasks = (SortTask*)realloc(pool->tasks, capacity * sizeof(SortTask));
+        if (!tasks)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            return false;
+        }
+
+        pool->tasks         = tasks;
+        pool->task_capacity = capacity;
+    }
+
+    pool->tasks[pool->task_count++] = {
+        .begin = begin,
+        .end   = end,
+        .depth = depth,
+    };
+    pool->pending++;
+
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    return true;
+}
+
+
+static void* sortWorker(void* argument)
+{
+    SortPool* pool = (SortPool*)argument;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (pool->task_count == 0 && pool->pending > 0)
+        {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        if (pool->task_count == 0)
+        {
+            break;
+        }
+
+        SortTask task = pool->tasks[--pool->task_count];
+        pthread_mutex_unlock(&pool->lock);
+
+        radixSort(pool, task.begin, task.end, task.depth);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+        {
+            pthread_cond_broadcast(&pool->ready);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+
+static char* writeCount(char* destination, size_t count)
+{
+    assert(destination != NULL);
+
+    char digits[MAX_COUNT_DIGITS] = {};
+    size_t length = 0;
+    do
+    {
+        digits[length++] = (char)('0' + count % 10);
+        count /= 10;
+    } while (count);
+
+    while (length)
+    {
+        *destination++ = digits[--length];
+    }
+
+    return destination;
+}
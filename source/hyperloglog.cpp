@@ -0,0 +1,175 @@
+#include "hyperloglog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+
+// static ----------------------------------------------------------------------
+
+
+static uint64_t hashKey(const char* key, size_t length);
+static double alphaForRegisters(size_t register_count);
+
+
+// public ----------------------------------------------------------------------
+
+
+HyperLogLogState hyperLogLogCtor(HyperLogLog* counter, int precision)
+{
+    assert(counter != NULL);
+
+    if (precision < HYPERLOGLOG_MIN_PRECISION || precision > HYPERLOGLOG_MAX_PRECISION)
+    {
+        fprintf(stderr, "Invalid hyperloglog precision %d\n", precision);
+        return HyperLogLogState_INVALID_INPUT;
+    }
+
+    counter->precision      = precision;
+    counter->register_count = (size_t)1 << precision;
+
+    counter->registers = (uint8_t*)calloc(counter->register_count, sizeof(uint8_t));
+    if (!counter->registers)
+    {
+        fprintf(stderr, "Error while allocating hyperloglog registers\n");
+        return HyperLogLogState_ALLOCATION_ERROR;
+    }
+
+    return HyperLogLogState_OK;
+}
+
+
+HyperLogLogState hyperLogLogDtor(HyperLogLog* counter)
+{
+    if (!counter)
+    {
+        return HyperLogLogState_ERROR;
+    }
+
+    free(counter->registers);
+    memset(counter, 0, sizeof(HyperLogLog));
+
+    return HyperLogLogState_OK;
+}
+
+
+void hyperLogLogAdd(HyperLogLog* counter, const char* key, size_t length)
+{
+    assert(counter != NULL);
+    assert(key     != NULL);
+
+    uint64_t hash  = hashKey(key, length);
+    size_t   index = hash >> (64 - counter->precision);
+
+    // sentinel bit keeps the rank bounded when the remaining bits are zero
+    uint64_t rest = (hash << counter->precision) | ((uint64_t)1 << (counter->precision - 1));
+    uint8_t  rank = (uint8_t)(__builtin_clzll(rest) + 1);
+
+    if (rank > counter->registers[index])
+    {
+        counter->registers[index] = rank;
+    }
+}
+
+
+size_t hyperLogLogEstimate(const HyperLogLog* counter)
+{
+    assert(counter != NULL);
+
+    size_t register_count = counter->register_count;
+
+    double sum   = 0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < register_count; i++)
+    {
+        sum   += ldexp(1.0, -counter->registers[i]);
+        zeros += counter->registers[i] == 0;
+    }
+
+    double estimate = alphaForRegisters(register_count)
+                    * register_count * register_count / sum;
+
+    // linear counting is more precise while many registers are still empty
+    if (estimate <= 2.5 * register_count && zeros != 0)
+    {
+        estimate = register_count * log((double)register_count / zeros);
+    }
+
+    return (size_t)(estimate + 0.5);
+}
+
+
+size_t hyperLogLogEstimateText(Text* text, int precision, size_t sample_stride)
+{
+    assert(text != NULL);
+
+    if (sample_stride == 0)
+    {
+        sample_stride = 1;
+    }
+
+    HyperLogLog counter = {};
+    if (hyperLogLogCtor(&counter, precision) != HyperLogLogState_OK)
+    {
+        return 0;
+    }
+
+    size_t saved_position = text->current_position;
+    textMoveToBegin(text);
+
+    char* word_pointer = NULL;
+    int   length       = 0;
+    size_t word_index  = 0;
+    while ((length = textNextWordPointer(text, &word_pointer)))
+    {
+        if (word_index++ % sample_stride == 0)
+        {
+            hyperLogLogAdd(&counter, word_pointer, length);
+        }
+    }
+
+    text->current_position = saved_position;
+
+    size_t estimate = hyperLogLogEstimate(&counter);
+    hyperLogLogDtor(&counter);
+
+    return estimate;
+}
+
+
+// static ----------------------------------------------------------------------
+
+
+static uint64_t hashKey(const char* key, size_t length)
+{
+    assert(key != NULL);
+
+    // fnv-1a with a murmur finalizer so every bit is well mixed
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+
+static double alphaForRegisters(size_t register_count)
+{
+    switch (register_count)
+    {
+        case 16: return 0.673;
+        case 32: return 0.697;
+        case 64: return 0.709;
+        default: return 0.7213 / (1.0 + 1.079 / register_count);
+    }
+}
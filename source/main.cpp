@@ -2,6 +2,11 @@
 
 #include "text_processing.h"
 #include "hash_table.h"
+#include "hash_table_export.h"
+#include "hyperloglog.h"
+
+
+#define WORD_BATCH_SIZE 64
 
 
 int main()
@@ -15,20 +20,31 @@ int main()
         return 1; 
     }
 
-    HashTable* hash_table = hashTableCtor();
+    size_t distinct_words = hyperLogLogEstimateText(&text, HYPERLOGLOG_DEFAULT_PRECISION, 1);
+
+    HashTable* hash_table = hashTableCtorWithHint(distinct_words);
+    hashTableSetKeyBase(hash_table, text.data);
+
+    const char* words[WORD_BATCH_SIZE] = {};
+    size_t lengths[WORD_BATCH_SIZE] = {};
+    size_t batch_size = 0;
 
     char* word_pointer = NULL;
     int length = 0;
     while((length = textNextWordPointer(&text, &word_pointer)))
     {
-        hashTableSet(hash_table, word_pointer, length);
+        words[batch_size]   = word_pointer;
+        lengths[batch_size] = length;
+
+        if (++batch_size == WORD_BATCH_SIZE)
+        {
+            hashTableSetBatch(hash_table, words, lengths, batch_size);
+            batch_size = 0;
+        }
     }
+    hashTableSetBatch(hash_table, words, lengths, batch_size);
 
-    //HashTableIterator iterator = hashTableIterator(hash_table);    
-    //while (hashTableNext(&iterator))
-    //{        
-    //    printf("%.*s %zu\n", (int)iterator.length, iterator.key, iterator.count);
-    //}
+    //hashTableExportSortedToFile(hash_table, HASH_TABLE_ORDER_COUNT, stdout);
 
     hashTableDtor(hash_table);
     textDtor(&text);
@@ -0,0 +1,590 @@
+#include "sharded_hash_table.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "hash_function.h"
+
+
+// static ----------------------------------------------------------------------
+
+
+#define MAX_NODES  64
+#define MAX_SHARDS 256
+#define SHARD_MIX  0x9E3779B1u // 2^32 / golden ratio
+
+#define NODE_CPULIST_FORMAT "/sys/devices/system/node/node%d/cpulist"
+
+
+// The part of one Apply call a shard has to run, operations[indices[i]].
+typedef struct ShardJob
+{
+    const ShardedOperation* operations;
+    const uint32_t*         hashes;
+    const size_t*           indices;
+    size_t                  count;
+    size_t*                 results;
+} ShardJob;
+
+typedef struct Shard
+{
+    HashTable* table;
+    cpu_set_t  cpus;
+    size_t     expected_length;
+    pthread_t  worker;
+
+    // the caller hands over a job and waits for has_job to drop
+    pthread_mutex_t         lock;
+    pthread_cond_t          wake;
+    ShardJob                job;
+    bool                    has_job;
+    bool                    quit;
+    bool                    started;
+    HashTableOperationError error;
+} Shard;
+
+typedef struct ShardedHashTable
+{
+    Shard* shards;
+    size_t shard_count;
+
+    // routing scratch reused between calls
+    uint32_t* hashes;
+    size_t*   shard_of;
+    size_t*   indices;
+    size_t    scratch_capacity;
+} ShardedHashTable;
+
+static size_t detectNodes(cpu_set_t* nodes, const cpu_set_t* allowed);
+static bool parseCpuList(const char* list, cpu_set_t* cpus);
+static void shardCpus(cpu_set_t* cpus, size_t shard, const cpu_set_t* nodes, size_t node_count,
+                      const cpu_set_t* allowed);
+static size_t shardIndex(const ShardedHashTable* table, uint32_t hash);
+static bool reserveScratch(ShardedHashTable* table, size_t count);
+static void* shardWorker(void* argument);
+static void shardRun(Shard* shard);
+
+
+// public ----------------------------------------------------------------------
+
+
+ShardedHashTable* shardedHashTableCtor(size_t shard_count, size_t expected_length)
+{
+    cpu_set_t allowed = {};
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        fprintf(stderr, "Could not read thread affinity\n");
+        return NULL;
+    }
+
+    cpu_set_t nodes[MAX_NODES] = {};
+    size_t node_count = detectNodes(nodes, &allowed);
+
+    if (shard_count == 0)
+    {
+        shard_count = node_count > 1 ? node_count : (size_t)CPU_COUNT(&allowed);
+    }
+    if (shard_count > MAX_SHARDS)
+    {
+        shard_count = MAX_SHARDS;
+    }
+
+    ShardedHashTable* table = (ShardedHashTable*)calloc(1, sizeof(ShardedHashTable));
+    Shard* shards = (Shard*)calloc(shard_count, sizeof(Shard));
+    if (!table || !shards)
+    {
+        fprintf(stderr, "Error while allocating memory for sharded table\n");
+        free(table);
+        free(shards);
+        return NULL;
+    }
+
+    table->shards = shards;
+
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        Shard* shard = &shards[i];
+
+        shardCpus(&shard->cpus, i, nodes, node_count, &allowed);
+        shard->expected_length = expected_length / shard_count;
+
+        pthread_mutex_init(&shard->lock, NULL);
+        pthread_cond_init(&shard->wake, NULL);
+
+        if (pthread_create(&shard->worker, NULL, shardWorker, shard) != 0)
+        {
+            fprintf(stderr, "Could not start shard worker\n");
+            pthread_mutex_destroy(&shard->lock);
+            pthread_cond_destroy(&shard->wake);
+            shardedHashTableDtor(table);
+            return NULL;
+        }
+        table->shard_count++;
+    }
+
+    // the workers create their own shards, wait until all of them did
+    bool failed = false;
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        Shard* shard = &shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        while (!shard->started)
+        {
+            pthread_cond_wait(&shard->wake, &shard->lock);
+        }
+        failed |= shard->table == NULL;
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    if (failed)
+    {
+        fprintf(stderr, "Error while creating hash table shards\n");
+        shardedHashTableDtor(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+HashTableOperationError shardedHashTableDtor(ShardedHashTable* table)
+{
+    if (!table)
+    {
+        fprintf(stderr, "Empty pointer on sharded table while destroing\n");
+        return HASH_TABLE_ERROR;
+    }
+
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        Shard* shard = &table->shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        shard->quit = true;
+        pthread_cond_broadcast(&shard->wake);
+        pthread_mutex_unlock(&shard->lock);
+
+        pthread_join(shard->worker, NULL);
+
+        pthread_mutex_destroy(&shard->lock);
+        pthread_cond_destroy(&shard->wake);
+    }
+
+    free(table->hashes);
+    free(table->shard_of);
+    free(table->indices);
+    free(table->shards);
+    free(table);
+
+    return HASH_TABLE_SUCCESS;
+}
+
+
+HashTableOperationError shardedHashTableSetKeyBase(ShardedHashTable* table, const char* key_base)
+{
+    assert(table != NULL);
+
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        HashTableOperationError error = hashTableSetKeyBase(table->shards[i].table, key_base);
+        if (error != HASH_TABLE_SUCCESS)
+        {
+            return error;
+        }
+    }
+
+    return HASH_TABLE_SUCCESS;
+}
+
+
+HashTableOperationError shardedHashTableApply(ShardedHashTable* table,
+                                              const ShardedOperation* operations,
+                                              size_t count, size_t* results)
+{
+    assert(table != NULL);
+
+    if (count == 0)
+    {
+        return HASH_TABLE_SUCCESS;
+    }
+    if (!operations)
+    {
+        return HASH_TABLE_INVALID_INPUT;
+    }
+    if (!reserveScratch(table, count))
+    {
+        return HASH_TABLE_BAD_MEMORY_ALLOCATION;
+    }
+
+    uint32_t* hashes = table->hashes;
+
+    size_t index = 0;
+    for (; index + HASH_STRING_LANES <= count; index += HASH_STRING_LANES)
+    {
+        const char* keys[HASH_STRING_LANES] = {};
+        size_t lengths[HASH_STRING_LANES] = {};
+        for (size_t lane = 0; lane < HASH_STRING_LANES; lane++)
+        {
+            keys[lane]    = operations[index + lane].key;
+            lengths[lane] = operations[index + lane].length;
+        }
+
+        hashString8(keys, lengths, hashes + index);
+    }
+    for (; index < count; index++)
+    {
+        hashes[index] = (uint32_t)hashString(operations[index].key, operations[index].length);
+    }
+
+    // counting sort by shard keeps every shard's operations in call order
+    size_t offsets[MAX_SHARDS + 1] = {};
+    for (size_t i = 0; i < count; i++)
+    {
+        table->shard_of[i] = shardIndex(table, hashes[i]);
+        offsets[table->shard_of[i] + 1]++;
+    }
+    for (size_t shard = 0; shard < table->shard_count; shard++)
+    {
+        offsets[shard + 1] += offsets[shard];
+    }
+
+    size_t positions[MAX_SHARDS] = {};
+    memcpy(positions, offsets, table->shard_count * sizeof(size_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        table->indices[positions[table->shard_of[i]]++] = i;
+    }
+
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        if (offsets[i] == offsets[i + 1])
+        {
+            continue;
+        }
+
+        Shard* shard = &table->shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        shard->job = {
+            .operations = operations,
+            .hashes     = hashes,
+            .indices    = table->indices + offsets[i],
+            .count      = offsets[i + 1] - offsets[i],
+            .results    = results,
+        };
+        shard->error   = HASH_TABLE_SUCCESS;
+        shard->has_job = true;
+        pthread_cond_broadcast(&shard->wake);
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    // shards without a job may still hold the error of an earlier call
+    HashTableOperationError error = HASH_TABLE_SUCCESS;
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        if (offsets[i] == offsets[i + 1])
+        {
+            continue;
+        }
+
+        Shard* shard = &table->shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        while (shard->has_job)
+        {
+            pthread_cond_wait(&shard->wake, &shard->lock);
+        }
+        if (shard->error != HASH_TABLE_SUCCESS)
+        {
+            error = shard->error;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    return error;
+}
+
+
+size_t shardedHashTableLength(ShardedHashTable* table)
+{
+    assert(table != NULL);
+
+    size_t length = 0;
+    for (size_t i = 0; i < table->shard_count; i++)
+    {
+        length += hashTabelLength(table->shards[i].table);
+    }
+
+    return length;
+}
+
+
+size_t shardedHashTableShardCount(ShardedHashTable* table)
+{
+    assert(table != NULL);
+
+    return table->shard_count;
+}
+
+
+size_t shardedHashTableShardOf(ShardedHashTable* table, const char* key, size_t length)
+{
+    assert(table != NULL);
+    assert(key   != NULL);
+
+    return shardIndex(table, (uint32_t)hashString(key, length));
+}
+
+
+HashTable* shardedHashTableShard(ShardedHashTable* table, size_t index)
+{
+    assert(table != NULL);
+
+    return index < table->shard_count ? table->shards[index].table : NULL;
+}
+
+
+// static ----------------------------------------------------------------------
+
+
+// Fills nodes with the allowed CPUs of every node that has some. Without
+// the sysfs node directory the whole machine counts as one node.
+static size_t detectNodes(cpu_set_t* nodes, const cpu_set_t* allowed)
+{
+    assert(nodes   != NULL);
+    assert(allowed != NULL);
+
+    size_t node_count = 0;
+    for (int node = 0; node < MAX_NODES; node++)
+    {
+        char path[sizeof(NODE_CPULIST_FORMAT) + 16] = {};
+        snprintf(path, sizeof(path), NODE_CPULIST_FORMAT, node);
+
+        FILE* file = fopen(path, "r");
+        if (!file)
+        {
+            continue;
+        }
+
+        char list[4096] = {};
+        bool has_list = fgets(list, sizeof(list), file) != NULL;
+        fclose(file);
+
+        cpu_set_t cpus = {};
+        if (!has_list || !parseCpuList(list, &cpus))
+        {
+            continue;
+        }
+
+        CPU_AND(&cpus, &cpus, allowed);
+        if (CPU_COUNT(&cpus) != 0)
+        {
+            nodes[node_count++] = cpus;
+        }
+    }
+
+    if (node_count == 0)
+    {
+        nodes[node_count++] = *allowed;
+    }
+
+    return node_count;
+}
+
+
+// parses the kernel cpu list format, like "0-3,8-11"
+static bool parseCpuList(const char* list, cpu_set_t* cpus)
+{
+    assert(list != NULL);
+    assert(cpus != NULL);
+
+    CPU_ZERO(cpus);
+
+    const char* position = list;
+    while (*position && *position != '\n')
+    {
+        char* end = NULL;
+        long first = strtol(position, &end, 10);
+        if (end == position)
+        {
+            return false;
+        }
+
+        long last = first;
+        if (*end == '-')
+        {
+            position = end + 1;
+            last = strtol(position, &end, 10);
+            if (end == position)
+            {
+                return false;
+            }
+        }
+
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+        }
+
+        position = *end == ',' ? end + 1 : end;
+    }
+
+    return true;
+}
+
+
+// Several nodes: the shard may run anywhere on its node. One node: the
+// shard gets a CPU of its own, round robin over the allowed ones.
+static void shardCpus(cpu_set_t* cpus, size_t shard, const cpu_set_t* nodes, size_t node_count,
+                      const cpu_set_t* allowed)
+{
+    assert(cpus    != NULL);
+    assert(nodes   != NULL);
+    assert(allowed != NULL);
+
+    if (node_count > 1)
+    {
+        *cpus = nodes[shard % node_count];
+        return;
+    }
+
+    size_t target = shard % CPU_COUNT(allowed);
+    CPU_ZERO(cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, allowed) && target-- == 0)
+        {
+            CPU_SET(cpu, cpus);
+            return;
+        }
+    }
+}
+
+
+// the tables bucket by the low hash bits, so shards take the high bits of a
+// multiplied hash and every shard still spreads over all its buckets
+static size_t shardIndex(const ShardedHashTable* table, uint32_t hash)
+{
+    assert(table != NULL);
+
+    uint32_t mixed = hash * SHARD_MIX;
+
+    return (size_t)(((uint64_t)mixed * table->shard_count) >> 32);
+}
+
+
+static bool reserveScratch(ShardedHashTable* table, size_t count)
+{
+    assert(table != NULL);
+
+    if (count <= table->scratch_capacity)
+    {
+        return true;
+    }
+
+    free(table->hashes);
+    free(table->shard_of);
+    free(table->indices);
+
+    table->hashes   = (uint32_t*)calloc(count, sizeof(uint32_t));
+    table->shard_of = (size_t*)  calloc(count, sizeof(size_t));
+    table->indices  = (size_t*)  calloc(count, sizeof(size_t));
+    if (!table->hashes || !table->shard_of || !table->indices)
+    {
+        fprintf(stderr, "Error while allocating memory for routing\n");
+        table->scratch_capacity = 0;
+        return false;
+    }
+
+    table->scratch_capacity = count;
+
+    return true;
+}
+
+
+static void* shardWorker(void* argument)
+{
+    Shard* shard = (Shard*)argument;
+
+    // pin before the shard is created so its pages come from this node
+    pthread_setaffinity_np(pthread_self(), sizeof(shard->cpus), &shard->cpus);
+
+    HashTable* table = hashTableCtorWithHint(shard->expected_length);
+
+    pthread_mutex_lock(&shard->lock);
+    shard->table   = table;
+    shard->started = true;
+    pthread_cond_broadcast(&shard->wake);
+
+    while (table)
+    {
+        while (!shard->has_job && !shard->quit)
+        {
+            pthread_cond_wait(&shard->wake, &shard->lock);
+        }
+        if (shard->quit)
+        {
+            break;
+        }
+
+        pthread_mutex_unlock(&shard->lock);
+        shardRun(shard);
+        pthread_mutex_lock(&shard->lock);
+
+        shard->has_job = false;
+        pthread_cond_broadcast(&shard->wake);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (table)
+    {
+        hashTableDtor(table);
+    }
+
+    return NULL;
+}
+
+
+static void shardRun(Shard* shard)
+{
+    assert(shard != NULL);
+
+    const ShardJob* job = &shard->job;
+
+    for (size_t i = 0; i < job->count; i++)
+    {
+        size_t index = job->indices[i];
+        const ShardedOperation* operation = &job->operations[index];
+        uint32_t hash = job->hashes[index];
+
+        switch (operation->type)
+        {
+            case ShardedOperation_GET:
+            {
+                size_t count = hashTableGetWithHash(shard->table, operation->key,
+                                                    operation->length, hash);
+                if (job->results)
+                {
+                    job->results[index] = count;
+                }
+                break;
+            }
+            case ShardedOperation_SET:
+                if (!hashTableSetWithHash(shard->table, operation->key, operation->length, hash))
+                {
+                    shard->error = HASH_TABLE_ERROR;
+                }
+                break;
+            case ShardedOperation_DELETE:
+                hashTableDelete(shard->table, operation->key, operation->length);
+                break;
+            default:
+                shard->error = HASH_TABLE_INVALID_INPUT;
+                break;
+        }
+    }
+}
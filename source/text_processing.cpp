@@ -6,6 +6,7 @@
 #include <assert.h>
 
 #include "hash_table.h"
+#include "hash_function.h"
 
 
 // static ----------------------------------------------------------------------
@@ -24,6 +25,13 @@ const char* NULL_TEXT_ERROR         = "No pointer on text";
 size_t getFileSize(FILE* file);
 
 
+typedef struct NgramToken
+{
+    const char*    pointer;
+    HashStringPart hash;
+} NgramToken;
+
+
 // public ----------------------------------------------------------------------
 
 
@@ -163,6 +171,60 @@ TextState textMoveToBegin(Text* text)
 }
 
 
+TextState textCountNgrams(Text* text, HashTable* table, size_t n)
+{
+    assert(text  != NULL);
+    assert(table != NULL);
+
+    if (n == 0 || n > TEXT_MAX_NGRAM)
+    {
+        fprintf(stderr, "N-gram length must be from 1 to %d\n", TEXT_MAX_NGRAM);
+        return TextState_ERROR;
+    }
+
+    // the hashes below are token hashes, a plain table would never find them
+    if (!hashTableHasTokenKeys(table) && hashTableSetTokenKeys(table) != HASH_TABLE_SUCCESS)
+    {
+        return TextState_ERROR;
+    }
+
+    // every word is hashed once, n-gram hashes are joined from the last n
+    // word hashes, so "a b" hashes as hashStringTokens does
+    HashStringPart space = hashStringPart(" ", 1);
+
+    NgramToken tokens[TEXT_MAX_NGRAM] = {};
+    size_t token_count = 0;
+
+    char* word_pointer = NULL;
+    int length = 0;
+    while ((length = textNextWordPointer(text, &word_pointer)))
+    {
+        tokens[token_count % n] = {
+            .pointer = word_pointer,
+            .hash    = hashStringPart(word_pointer, length),
+        };
+        if (++token_count < n)
+        {
+            continue;
+        }
+
+        const NgramToken* first = &tokens[token_count % n];
+        HashStringPart hash = first->hash;
+        for (size_t i = 1; i < n; i++)
+        {
+            hash = hashStringJoin(hashStringJoin(hash, space), tokens[(token_count + i) % n].hash);
+        }
+
+        size_t span = word_pointer + length - first->pointer;
+        if (!hashTableSetWithHash(table, first->pointer, span, hashStringFinish(hash)))
+        {
+            return TextState_ERROR;
+        }
+    }
+
+    return TextState_OK;
+}
+
 
 // static ----------------------------------------------------------------------
 
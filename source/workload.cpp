@@ -0,0 +1,325 @@
+#include "workload.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "hash_table.h"
+
+
+// static ----------------------------------------------------------------------
+
+
+#define ADDITIONAL_SPACE 10
+#define ALPHABET_SIZE    26
+
+
+typedef struct Random
+{
+    uint64_t state;
+} Random;
+
+
+static uint64_t randomNext(Random* random);
+static double randomUniform(Random* random);
+
+static size_t nextKeyLength(Random* random, const WorkloadConfig* config);
+static WorkloadState validateConfig(const WorkloadConfig* config);
+static double* buildZipfTable(size_t size, double skew);
+static size_t sampleZipf(Random* random, const double* cdf, size_t size);
+
+
+// public ----------------------------------------------------------------------
+
+
+WorkloadConfig workloadDefaultConfig(void)
+{
+    return {
+        .seed = 42,
+
+        .vocabulary_size = 10000,
+        .operation_count = 1000000,
+
+        .zipf_skew = 0.99,
+
+        .length_distribution = WorkloadLength_GEOMETRIC,
+        .min_key_length      = 1,
+        .max_key_length      = 32,
+        .mean_key_length     = 6.0,
+
+        .get_percent    = 90,
+        .set_percent    = 9,
+        .delete_percent = 1,
+    };
+}
+
+
+WorkloadState workloadGenerate(Workload* workload, const WorkloadConfig* config)
+{
+    assert(workload != NULL);
+    assert(config   != NULL);
+
+    WorkloadState state = validateConfig(config);
+    if (state != WorkloadState_OK)
+    {
+        return state;
+    }
+
+    memset(workload, 0, sizeof(Workload));
+
+    Random random = { .state = config->seed };
+
+    size_t vocabulary_size = config->vocabulary_size;
+
+    workload->keys        = (const char**)calloc(vocabulary_size, sizeof(const char*));
+    workload->key_lengths = (size_t*)calloc(vocabulary_size, sizeof(size_t));
+    workload->operations  = (WorkloadOperation*)calloc(config->operation_count,
+                                                       sizeof(WorkloadOperation));
+    if (!workload->keys || !workload->key_lengths || !workload->operations)
+    {
+        fprintf(stderr, "Error while allocating memory for workload\n");
+        workloadDtor(workload);
+        return WorkloadState_ALLOCATION_ERROR;
+    }
+
+    // a key may take up to max_key_length bytes, so redrawing one never
+    // moves the keys before it
+    workload->key_arena = (char*)calloc(vocabulary_size * config->max_key_length + ADDITIONAL_SPACE,
+                                        sizeof(char));
+    HashTable* drawn_keys = hashTableCtorWithHint(vocabulary_size);
+    if (!workload->key_arena || !drawn_keys)
+    {
+        fprintf(stderr, "Error while allocating memory for workload keys\n");
+        if (drawn_keys)
+        {
+            hashTableDtor(drawn_keys);
+        }
+        workloadDtor(workload);
+        return WorkloadState_ALLOCATION_ERROR;
+    }
+    hashTableSetKeyBase(drawn_keys, workload->key_arena);
+
+    // every rank gets a key of its own, a repeated key is drawn again
+    char* current_key = workload->key_arena;
+    for (size_t i = 0; i < vocabulary_size; i++)
+    {
+        size_t length = 0;
+        do
+        {
+            length = nextKeyLength(&random, config);
+            for (size_t j = 0; j < length; j++)
+            {
+                current_key[j] = (char)('a' + randomNext(&random) % ALPHABET_SIZE);
+            }
+        } while (hashTableGet(drawn_keys, current_key, length) != 0);
+
+        if (!hashTableSet(drawn_keys, current_key, length))
+        {
+            hashTableDtor(drawn_keys);
+            workloadDtor(workload);
+            return WorkloadState_ERROR;
+        }
+
+        workload->keys[i]        = current_key;
+        workload->key_lengths[i] = length;
+        current_key += length;
+    }
+    hashTableDtor(drawn_keys);
+    workload->key_count = vocabulary_size;
+
+    double* cdf = buildZipfTable(vocabulary_size, config->zipf_skew);
+    if (!cdf)
+    {
+        fprintf(stderr, "Error while allocating memory for zipf table\n");
+        workloadDtor(workload);
+        return WorkloadState_ALLOCATION_ERROR;
+    }
+
+    for (size_t i = 0; i < config->operation_count; i++)
+    {
+        unsigned roll = (unsigned)(randomNext(&random) % 100);
+
+        WorkloadOperation* operation = &workload->operations[i];
+        if (roll < config->get_percent)
+        {
+            operation->type = WorkloadOperation_GET;
+        }
+        else if (roll < config->get_percent + config->set_percent)
+        {
+            operation->type = WorkloadOperation_SET;
+        }
+        else
+        {
+            operation->type = WorkloadOperation_DELETE;
+        }
+
+        operation->key_index = (uint32_t)sampleZipf(&random, cdf, vocabulary_size);
+    }
+    workload->operation_count = config->operation_count;
+
+    free(cdf);
+
+    return WorkloadState_OK;
+}
+
+
+WorkloadState workloadDtor(Workload* workload)
+{
+    if (!workload)
+    {
+        return WorkloadState_ERROR;
+    }
+
+    free(workload->key_arena);
+    free(workload->keys);
+    free(workload->key_lengths);
+    free(workload->operations);
+    memset(workload, 0, sizeof(Workload));
+
+    return WorkloadState_OK;
+}
+
+
+// static ----------------------------------------------------------------------
+
+
+static uint64_t randomNext(Random* random)
+{
+    assert(random != NULL);
+
+    // splitmix64
+    uint64_t z = (random->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+
+static double randomUniform(Random* random)
+{
+    assert(random != NULL);
+
+    return (double)(randomNext(random) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+static size_t nextKeyLength(Random* random, const WorkloadConfig* config)
+{
+    assert(random != NULL);
+    assert(config != NULL);
+
+    size_t min_length = config->min_key_length;
+    size_t max_length = config->max_key_length;
+
+    if (config->length_distribution == WorkloadLength_UNIFORM)
+    {
+        return min_length + randomNext(random) % (max_length - min_length + 1);
+    }
+
+    double probability = 1.0 / (config->mean_key_length - (double)min_length + 1.0);
+    if (probability >= 1.0)
+    {
+        return min_length;
+    }
+
+    double extra  = floor(log(1.0 - randomUniform(random)) / log(1.0 - probability));
+    size_t length = min_length + (size_t)extra;
+
+    return length > max_length ? max_length : length;
+}
+
+
+static WorkloadState validateConfig(const WorkloadConfig* config)
+{
+    assert(config != NULL);
+
+    if (config->vocabulary_size == 0
+     || config->vocabulary_size > UINT32_MAX
+     || config->min_key_length  == 0
+     || config->min_key_length  >  config->max_key_length
+     || config->zipf_skew       <  0
+     || (config->length_distribution == WorkloadLength_GEOMETRIC
+      && !(config->mean_key_length >= (double)config->min_key_length)))
+    {
+        fprintf(stderr, "Invalid workload config\n");
+        return WorkloadState_INVALID_CONFIG;
+    }
+
+    // keys are unique, so the lengths must leave room for enough of them
+    size_t available_keys = 0;
+    size_t keys_of_length = 1;
+    for (size_t length = 1;
+         length <= config->max_key_length && available_keys < config->vocabulary_size;
+         length++)
+    {
+        keys_of_length *= ALPHABET_SIZE;
+        if (length >= config->min_key_length)
+        {
+            available_keys += keys_of_length;
+        }
+    }
+    if (available_keys < config->vocabulary_size)
+    {
+        fprintf(stderr, "Key lengths leave too few distinct keys for the vocabulary\n");
+        return WorkloadState_INVALID_CONFIG;
+    }
+
+    if (config->get_percent + config->set_percent + config->delete_percent != 100)
+    {
+        fprintf(stderr, "Workload operation mix must sum up to 100\n");
+        return WorkloadState_INVALID_CONFIG;
+    }
+
+    return WorkloadState_OK;
+}
+
+
+static double* buildZipfTable(size_t size, double skew)
+{
+    double* cdf = (double*)calloc(size, sizeof(double));
+    if (!cdf)
+    {
+        return NULL;
+    }
+
+    double sum = 0;
+    for (size_t rank = 0; rank < size; rank++)
+    {
+        sum += 1.0 / pow((double)(rank + 1), skew);
+        cdf[rank] = sum;
+    }
+
+    for (size_t rank = 0; rank < size; rank++)
+    {
+        cdf[rank] /= sum;
+    }
+
+    return cdf;
+}
+
+
+static size_t sampleZipf(Random* random, const double* cdf, size_t size)
+{
+    assert(random != NULL);
+    assert(cdf    != NULL);
+
+    double value = randomUniform(random);
+
+    size_t left  = 0;
+    size_t right = size - 1;
+    while (left < right)
+    {
+        size_t middle = left + (right - left) / 2;
+        if (cdf[middle] < value)
+        {
+            left = middle + 1;
+        }
+        else
+        {
+            right = middle;
+        }
+    }
+
+    return left;
+}